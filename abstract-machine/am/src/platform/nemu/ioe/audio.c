@@ -8,19 +8,45 @@
 #define AUDIO_INIT_ADDR      (AUDIO_ADDR + 0x10)
 #define AUDIO_COUNT_ADDR     (AUDIO_ADDR + 0x14)
 
+static int sbuf_size = 0;
+static int sbuf_pos = 0; // write cursor of the stream buffer
+
 void __am_audio_init() {
+  sbuf_size = inl(AUDIO_SBUF_SIZE_ADDR);
 }
 
 void __am_audio_config(AM_AUDIO_CONFIG_T *cfg) {
-  cfg->present = false;
+  cfg->present = true;
+  cfg->bufsize = sbuf_size;
 }
 
 void __am_audio_ctrl(AM_AUDIO_CTRL_T *ctrl) {
+  outl(AUDIO_FREQ_ADDR, ctrl->freq);
+  outl(AUDIO_CHANNELS_ADDR, ctrl->channels);
+  outl(AUDIO_SAMPLES_ADDR, ctrl->samples);
+  outl(AUDIO_INIT_ADDR, 1);
+  sbuf_pos = 0;
 }
 
 void __am_audio_status(AM_AUDIO_STATUS_T *stat) {
-  stat->count = 0;
+  stat->count = inl(AUDIO_COUNT_ADDR);
 }
 
 void __am_audio_play(AM_AUDIO_PLAY_T *ctl) {
+  uint8_t *buf = ctl->buf.start;
+  int len = (uint8_t *)ctl->buf.end - buf;
+  while (len > 0) {
+    // wait until the device has drained some data
+    int nfree = sbuf_size - inl(AUDIO_COUNT_ADDR);
+    if (nfree == 0) continue;
+    int n = (len < nfree ? len : nfree);
+    for (int i = 0; i < n; i ++) {
+      outb(AUDIO_SBUF_ADDR + sbuf_pos, buf[i]);
+      sbuf_pos = (sbuf_pos + 1) % sbuf_size;
+    }
+    // writing the count register commits the new data to the device
+    outl(AUDIO_COUNT_ADDR, n);
+    buf += n;
+    len -= n;
+  }
 }
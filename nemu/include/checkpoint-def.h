@@ -0,0 +1,49 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CHECKPOINT_DEF_H__
+#define __CHECKPOINT_DEF_H__
+
+#include <stdint.h>
+
+/* The checkpoint taken at the start of an interval of SimPoint, to be
+ * restored by NEMU or loaded by the RTL testbench. The file starts with a
+ * CptHeader, followed by `cpu_size` bytes of the CPU_state of the ISA,
+ * `isa_size` bytes of the other states of the ISA (such as the counters,
+ * see isa_cpt_save()), and `nr_page` pages of pmem, each of which is the
+ * 8-byte guest physical address of the page and CPT_PAGE_SIZE bytes of
+ * data. The pages not in the file are filled with `fill'. The states of
+ * devices are not saved.
+ */
+#define CPT_MAGIC "NEMUCPT"
+#define CPT_VERSION 2
+#define CPT_PAGE_SIZE 4096
+
+typedef struct {
+  char magic[8];
+  uint8_t version;
+  uint8_t word_size;  // in bytes
+  char isa[14];       // e.g. "riscv32"
+  uint32_t cpu_size;
+  uint32_t isa_size;
+  uint8_t fill;       // the value of each byte in the pages not in the file
+  uint8_t pad[7];
+  uint64_t pc;
+  uint64_t nr_inst;   // number of instructions executed before the checkpoint
+  uint64_t interval;  // index of the interval starting at the checkpoint
+  uint64_t nr_page;
+} CptHeader;
+
+#endif
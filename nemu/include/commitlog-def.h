@@ -0,0 +1,87 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __COMMITLOG_DEF_H__
+#define __COMMITLOG_DEF_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/* The binary commit log, shared by NEMU and tools/commit-diff.
+ * The file starts with a ClogHeader, followed by chunks. Each chunk is a
+ * ClogChunkHeader and `zsize` bytes of records compressed by zlib, which
+ * are `size` bytes after decompression. If compression does not help,
+ * `zsize` is 0 and the `size` bytes of records are stored as is. A record is
+ *   flag (1 byte) | zigzag(pc - last pc) | inst (4 bytes)
+ *   | [rd (1 byte) | zigzag(value - last value of rd)]   if CLOG_RD
+ *   | [zigzag(addr - last addr) | data]                    if CLOG_LOAD/CLOG_STORE
+ * where the non-fixed fields are varints. All the "last" values are reset
+ * to 0 at the beginning of a chunk, so a chunk can be decoded alone.
+ */
+#define CLOG_MAGIC "NEMUCLOG"
+#define CLOG_VERSION 2
+#define CLOG_CHUNK_SIZE (64 * 1024)
+#define CLOG_MAX_RECORD 64
+#define CLOG_NR_REG 64
+
+typedef struct {
+  char magic[8];
+  uint8_t version;
+  uint8_t word_size;  // in bytes
+  uint8_t pad[6];
+} ClogHeader;
+
+typedef struct {
+  uint32_t nr_inst;
+  uint32_t size;
+  uint32_t zsize;
+  uint32_t pad;
+  uint64_t first_inst;  // index of the first instruction in the chunk
+} ClogChunkHeader;
+
+enum {
+  CLOG_RD = 0x1, CLOG_LOAD = 0x2, CLOG_STORE = 0x4,
+  // log2 of the length of the data access in bits [4:3]
+  CLOG_LEN_SHIFT = 3, CLOG_LEN_MASK = 0x18,
+};
+
+static inline uint8_t* clog_put_varint(uint8_t *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p ++ = v | 0x80;
+    v >>= 7;
+  }
+  *p ++ = v;
+  return p;
+}
+
+static inline const uint8_t* clog_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+  uint64_t x = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t b = *p ++;
+    x |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) { *v = x; return p; }
+  }
+  return NULL;
+}
+
+static inline uint64_t clog_zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t clog_unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+#endif
@@ -0,0 +1,33 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_BPSIM_H__
+#define __CPU_BPSIM_H__
+
+#include <common.h>
+
+struct Decode;
+
+void init_bpsim();
+// called by the instructions of conditional branches
+void bpsim_branch(vaddr_t pc, bool taken, vaddr_t target);
+// called by the instructions of jumps, after `dnpc` is set
+void bpsim_jump(struct Decode *s);
+void bpsim_report();
+// total mispredictions so far, by the last (most elaborate) direction
+// predictor, the BTB and the RAS
+uint64_t bpsim_nr_miss();
+
+#endif
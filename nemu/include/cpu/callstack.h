@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_CALLSTACK_H__
+#define __CPU_CALLSTACK_H__
+
+#include <common.h>
+
+#define CALLSTACK_MAX_DEPTH 1024
+
+struct Decode;
+
+/* The shadow call stack maintained with isa_jump_type(), shared by the
+ * profiler and ftrace. It is updated once per instruction before them.
+ */
+typedef struct {
+  // the entry of the program and the called functions,
+  // where deeper frames are counted but dropped
+  vaddr_t entry[CALLSTACK_MAX_DEPTH];
+  int depth;
+  int jump;  // INST_JUMP_* of the last instruction
+} CallStack;
+
+extern CallStack g_callstack;
+
+void init_callstack();
+void callstack_step(struct Decode *s);
+
+#endif
@@ -20,6 +20,10 @@
 
 void cpu_exec(uint64_t n);
 
+// true while an instruction is being executed, to tell the memory accesses
+// of the guest from those of the monitor (such as `x` and watchpoints)
+extern bool g_inst_exec;
+
 void set_nemu_state(int state, vaddr_t pc, int halt_ret);
 void invalid_inst(vaddr_t thispc);
 
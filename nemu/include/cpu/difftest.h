@@ -19,11 +19,14 @@
 #include <common.h>
 #include <difftest-def.h>
 
+struct Decode;
+
 #ifdef CONFIG_DIFFTEST
 void difftest_skip_ref();
 void difftest_skip_dut(int nr_ref, int nr_dut);
 void difftest_set_patch(void (*fn)(void *arg), void *arg);
 void difftest_step(vaddr_t pc, vaddr_t npc);
+void difftest_sync();
 void difftest_detach();
 void difftest_attach();
 #else
@@ -31,10 +34,16 @@ static inline void difftest_skip_ref() {}
 static inline void difftest_skip_dut(int nr_ref, int nr_dut) {}
 static inline void difftest_set_patch(void (*fn)(void *arg), void *arg) {}
 static inline void difftest_step(vaddr_t pc, vaddr_t npc) {}
+static inline void difftest_sync() {}
 static inline void difftest_detach() {}
 static inline void difftest_attach() {}
 #endif
 
+#ifdef CONFIG_DIFFTEST_PIPELINE
+void difftest_commit(struct Decode *s, vaddr_t npc);
+void difftest_record_store(paddr_t addr, int len, word_t data);
+#endif
+
 extern void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction);
 extern void (*ref_difftest_regcpy)(void *dut, bool direction);
 extern void (*ref_difftest_exec)(uint64_t n);
@@ -0,0 +1,28 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_SIMPOINT_H__
+#define __CPU_SIMPOINT_H__
+
+#include <common.h>
+
+struct Decode;
+
+void init_simpoint(const char *bbv_file, const char *simpoints_file, const char *cpt_dir);
+// return the number of bytes from RESET_VECTOR to the end of pmem
+long simpoint_restore(const char *cpt_file);
+void simpoint_step(struct Decode *s);
+
+#endif
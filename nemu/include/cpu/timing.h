@@ -0,0 +1,36 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_TIMING_H__
+#define __CPU_TIMING_H__
+
+#include <common.h>
+
+struct Decode;
+
+#ifdef CONFIG_TIMING
+void timing_step(struct Decode *s);
+void timing_report();
+// the cycles seen by the guest, e.g. in `mcycle'
+uint64_t timing_cycles();
+#else
+// one cycle per instruction without the timing model
+static inline uint64_t timing_cycles() {
+  extern uint64_t g_nr_guest_inst;
+  return g_nr_guest_inst;
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __DIFFTEST_SHM_H__
+#define __DIFFTEST_SHM_H__
+
+#include <common.h>
+#include <difftest-def.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The channel between DUT and a REF running in another process.
+ * DUT fills in a request and rings `req_seq`, then the server of REF
+ * (tools/difftest-shm) serves it and rings `resp_seq` with the same value.
+ */
+enum {
+  SHM_CMD_HELLO, SHM_CMD_INIT, SHM_CMD_MEMCPY, SHM_CMD_REGCPY,
+  SHM_CMD_EXEC, SHM_CMD_RAISE_INTR, SHM_CMD_DIRTY, SHM_CMD_MEMHASH,
+  SHM_CMD_RUN_TO_PC,
+};
+
+// optional functions exported by REF, replied to SHM_CMD_HELLO
+#define SHM_HAS_MEMCHECK 0x1
+#define SHM_HAS_RUN_TO_PC 0x2
+
+#define SHM_DATA_SIZE (1 << 20)
+
+typedef struct {
+  uint32_t req_seq, resp_seq; // futex words
+  int cmd;
+  bool direction;
+  uint64_t addr, n, arg;
+  uint8_t data[SHM_DATA_SIZE] __attribute__((aligned(8)));
+} DifftestShm;
+
+static inline void shm_ring(uint32_t *bell, uint32_t seq) {
+  __atomic_store_n(bell, seq, __ATOMIC_RELEASE);
+  syscall(SYS_futex, bell, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// wait until `bell` is rung with `seq`, return false on timeout
+static inline bool shm_wait(uint32_t *bell, uint32_t seq, long timeout_ms) {
+  // most requests are served within microseconds, so spin first
+  for (int spin = 0; spin < 4096; spin ++) {
+    if (__atomic_load_n(bell, __ATOMIC_ACQUIRE) == seq) return true;
+  }
+  struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000 };
+  uint32_t cur;
+  while ((cur = __atomic_load_n(bell, __ATOMIC_ACQUIRE)) != seq) {
+    if (syscall(SYS_futex, bell, FUTEX_WAIT, cur, (timeout_ms < 0 ? NULL : &ts), NULL, 0) != 0 &&
+        errno == ETIMEDOUT) {
+      return __atomic_load_n(bell, __ATOMIC_ACQUIRE) == seq;
+    }
+  }
+  return true;
+}
+
+#endif
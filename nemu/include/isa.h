@@ -32,10 +32,23 @@ void init_isa();
 extern CPU_state cpu;
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
+word_t* isa_reg_str2ptr(const char *name);
 
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
+// whether the executed instruction is a function call or return
+enum { INST_JUMP_NONE, INST_JUMP_CALL, INST_JUMP_RET };
+int isa_jump_type(struct Decode *s);
+// class of the executed instruction, for the statistics of instruction mix
+enum {
+  INST_CLASS_ALU, INST_CLASS_MULDIV, INST_CLASS_LOAD, INST_CLASS_STORE,
+  INST_CLASS_BRANCH, INST_CLASS_JUMP, INST_CLASS_CSR, INST_CLASS_SYSTEM,
+  INST_CLASS_OTHER, NR_INST_CLASS
+};
+int isa_inst_class(struct Decode *s);
+// registers read and written by the instruction, or -1 if not used
+void isa_inst_regs(struct Decode *s, int *rd, int *rs1, int *rs2);
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
@@ -54,5 +67,13 @@ word_t isa_query_intr();
 // difftest
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc);
 void isa_difftest_attach();
+// index of the word in CPU_state written by the instruction, or -1 if none or unknown
+int isa_difftest_commit_reg(struct Decode *s);
+
+// checkpoint
+// save the state outside of CPU_state (such as the counters) into `buf`
+// of at most `size` bytes, and return the number of bytes saved
+size_t isa_cpt_save(void *buf, size_t size);
+void isa_cpt_restore(const void *buf, size_t size);
 
 #endif
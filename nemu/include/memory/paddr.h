@@ -17,6 +17,7 @@
 #define __MEMORY_PADDR_H__
 
 #include <common.h>
+#include <memory/vaddr.h>
 
 #define PMEM_LEFT  ((paddr_t)CONFIG_MBASE)
 #define PMEM_RIGHT ((paddr_t)CONFIG_MBASE + CONFIG_MSIZE - 1)
@@ -31,7 +32,27 @@ static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+// the value of each byte of pmem after init_mem()
+extern uint8_t pmem_init_byte;
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
+#ifdef CONFIG_PMEM_DIRTY
+#define NR_PMEM_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+// users of the dirty map, each of which owns a bit in pmem_dirty[]
+enum { DIRTY_DIFFTEST_SNAPSHOT, DIRTY_DIFFTEST_MEMCHECK, DIRTY_DIFFTEST_FAST_FORWARD };
+// one byte per page of pmem, all bits are set by stores
+extern uint8_t pmem_dirty[];
+void paddr_dirty_clear(int user);
+#define paddr_is_dirty(page, user) ((pmem_dirty[page] >> (user)) & 1)
+#endif
+
+#ifdef CONFIG_WATCHPOINT
+// filter of physical ranges watched by data watchpoints
+extern bool paddr_watch_triggered;
+void paddr_watch_add(paddr_t addr, int len);
+void paddr_watch_clear();
+#endif
+
 #endif
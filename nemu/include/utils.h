@@ -34,6 +34,46 @@ extern NEMUState nemu_state;
 
 uint64_t get_time();
 
+// ----------- self profiling -----------
+
+// host time spent in each part of NEMU, where some parts contain others
+enum { SP_EXECUTE, SP_EXEC_ONCE, SP_MEM, SP_MMIO, SP_TRACE, SP_DIFFTEST, SP_DEVICE, NR_SP };
+
+#ifdef CONFIG_SELF_PROFILE
+extern uint64_t self_prof_cycles[NR_SP];
+uint64_t self_prof_now();
+void self_prof_report();
+
+typedef struct { uint64_t start; int id; } SelfProfScope;
+static inline void self_prof_scope_end(SelfProfScope *s) {
+  self_prof_cycles[s->id] += self_prof_now() - s->start;
+}
+
+#define SELF_PROF_BEGIN(id) uint64_t concat(__self_prof_, id) = self_prof_now()
+#define SELF_PROF_END(id) self_prof_cycles[id] += self_prof_now() - concat(__self_prof_, id)
+// measure until the end of the enclosing scope
+#define SELF_PROF_SCOPE(id) \
+  SelfProfScope concat(__self_prof_scope_, __LINE__) __attribute__((cleanup(self_prof_scope_end))) = \
+    { self_prof_now(), id }
+#else
+#define SELF_PROF_BEGIN(id)
+#define SELF_PROF_END(id)
+#define SELF_PROF_SCOPE(id)
+#endif
+
+// ----------- hash -----------
+
+uint64_t hash64(const void *buf, size_t len);
+
+// ----------- symbol -----------
+
+void init_elf(const char *elf_file);
+// index of the function containing `addr`, or -1 if not found
+int symbol_find(vaddr_t addr);
+const char* symbol_name(int idx);
+vaddr_t symbol_addr(int idx);
+int symbol_nr();
+
 // ----------- log -----------
 
 #define ANSI_FG_BLACK   "\33[1;30m"
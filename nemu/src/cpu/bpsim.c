@@ -0,0 +1,253 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/bpsim.h>
+
+#ifdef CONFIG_BPSIM
+/* All the direction predictors see the same stream of conditional branches
+ * in one run. A new predictor only needs to provide predict() and update(),
+ * and be listed in `preds`. The targets of taken branches and jumps are
+ * predicted by a BTB, except returns, which are predicted by a RAS.
+ */
+typedef struct Predictor {
+  const char *name;
+  bool (*predict)(vaddr_t pc);
+  // called right after predict() with the same pc
+  void (*update)(vaddr_t pc, bool taken);
+  uint64_t nr_miss;
+} Predictor;
+
+static uint64_t nr_branch = 0, nr_jump = 0;
+
+static inline void ctr_update(int8_t *c, bool taken, int min, int max) {
+  if (taken) { if (*c < max) (*c) ++; }
+  else { if (*c > min) (*c) --; }
+}
+
+// ---------------- bimodal ----------------
+
+#define BIMODAL_SIZE (1 << CONFIG_BPSIM_BIMODAL_BITS)
+static int8_t bimodal[BIMODAL_SIZE];  // 2-bit counters, taken if >= 2
+
+static inline uint32_t bimodal_idx(vaddr_t pc) { return (pc >> 2) & (BIMODAL_SIZE - 1); }
+static bool bimodal_predict(vaddr_t pc) { return bimodal[bimodal_idx(pc)] >= 2; }
+static void bimodal_update(vaddr_t pc, bool taken) { ctr_update(&bimodal[bimodal_idx(pc)], taken, 0, 3); }
+
+// ---------------- gshare ----------------
+
+#define GSHARE_SIZE (1 << CONFIG_BPSIM_GSHARE_BITS)
+static int8_t gshare[GSHARE_SIZE];
+static uint64_t gshare_hist = 0;
+
+static inline uint32_t gshare_idx(vaddr_t pc) { return ((pc >> 2) ^ gshare_hist) & (GSHARE_SIZE - 1); }
+static bool gshare_predict(vaddr_t pc) { return gshare[gshare_idx(pc)] >= 2; }
+static void gshare_update(vaddr_t pc, bool taken) {
+  ctr_update(&gshare[gshare_idx(pc)], taken, 0, 3);
+  gshare_hist = (gshare_hist << 1) | taken;
+}
+
+// ---------------- TAGE-lite ----------------
+
+/* A bimodal base predictor and tagged tables indexed with geometric
+ * history lengths, without the alternate-prediction heuristics.
+ */
+#define TAGE_NR_TABLE 4
+#define TAGE_BITS CONFIG_BPSIM_TAGE_BITS
+#define TAGE_SIZE (1 << TAGE_BITS)
+#define TAGE_TAG_BITS 8
+#define TAGE_HIST_WORDS 4
+#define TAGE_U_RESET_PERIOD (256 * 1024)
+
+static const int tage_hist_len[TAGE_NR_TABLE] = { 5, 15, 44, 130 };
+
+typedef struct {
+  int8_t ctr;  // 3-bit signed, taken if >= 0
+  uint8_t u;   // 2-bit usefulness
+  uint16_t tag;
+} TageEntry;
+
+static int8_t tage_base[BIMODAL_SIZE];
+static TageEntry tage[TAGE_NR_TABLE][TAGE_SIZE];
+static uint64_t tage_hist[TAGE_HIST_WORDS];  // bit 0 of word 0 is the latest
+static uint64_t tage_nr_update = 0;
+// computed by predict() and used by update()
+static uint32_t tage_idx[TAGE_NR_TABLE], tage_tag[TAGE_NR_TABLE];
+static int tage_provider;
+static bool tage_pred, tage_alt_pred;
+
+// xor the first `len` bits of the history in chunks of `bits`
+static uint32_t tage_fold(int len, int bits) {
+  uint32_t f = 0;
+  for (int i = 0; i < len; i += bits) {
+    int n = (len - i < bits ? len - i : bits);
+    int w = i / 64, b = i % 64;
+    uint64_t x = tage_hist[w] >> b;
+    if (b + n > 64 && w + 1 < TAGE_HIST_WORDS) x |= tage_hist[w + 1] << (64 - b);
+    f ^= x & ((1u << n) - 1);
+  }
+  return f;
+}
+
+static bool tage_predict(vaddr_t pc) {
+  uint32_t p = pc >> 2;
+  tage_provider = -1;
+  tage_alt_pred = tage_pred = tage_base[bimodal_idx(pc)] >= 2;
+  for (int t = 0; t < TAGE_NR_TABLE; t ++) {
+    int len = tage_hist_len[t];
+    tage_idx[t] = (p ^ (p >> TAGE_BITS) ^ tage_fold(len, TAGE_BITS)) & (TAGE_SIZE - 1);
+    tage_tag[t] = (p ^ tage_fold(len, TAGE_TAG_BITS) ^ (tage_fold(len, TAGE_TAG_BITS - 1) << 1)) &
+      ((1u << TAGE_TAG_BITS) - 1);
+    if (tage[t][tage_idx[t]].tag == tage_tag[t]) {
+      tage_alt_pred = tage_pred;
+      tage_pred = tage[t][tage_idx[t]].ctr >= 0;
+      tage_provider = t;
+    }
+  }
+  return tage_pred;
+}
+
+static void tage_update(vaddr_t pc, bool taken) {
+  if (tage_provider >= 0) {
+    TageEntry *e = &tage[tage_provider][tage_idx[tage_provider]];
+    ctr_update(&e->ctr, taken, -4, 3);
+    if (tage_pred != tage_alt_pred) {
+      if (tage_pred == taken) { if (e->u < 3) e->u ++; }
+      else { if (e->u > 0) e->u --; }
+    }
+  } else {
+    ctr_update(&tage_base[bimodal_idx(pc)], taken, 0, 3);
+  }
+
+  // allocate an entry in a table with longer history on a misprediction
+  if (tage_pred != taken) {
+    bool allocated = false;
+    for (int t = tage_provider + 1; t < TAGE_NR_TABLE; t ++) {
+      TageEntry *e = &tage[t][tage_idx[t]];
+      if (e->u == 0) {
+        *e = (TageEntry) { .ctr = (taken ? 0 : -1), .u = 0, .tag = tage_tag[t] };
+        allocated = true;
+        break;
+      }
+    }
+    if (!allocated) {
+      for (int t = tage_provider + 1; t < TAGE_NR_TABLE; t ++) {
+        if (tage[t][tage_idx[t]].u > 0) tage[t][tage_idx[t]].u --;
+      }
+    }
+  }
+
+  if (++ tage_nr_update % TAGE_U_RESET_PERIOD == 0) {
+    for (int t = 0; t < TAGE_NR_TABLE; t ++) {
+      for (int i = 0; i < TAGE_SIZE; i ++) tage[t][i].u >>= 1;
+    }
+  }
+
+  for (int w = TAGE_HIST_WORDS - 1; w > 0; w --) {
+    tage_hist[w] = (tage_hist[w] << 1) | (tage_hist[w - 1] >> 63);
+  }
+  tage_hist[0] = (tage_hist[0] << 1) | taken;
+}
+
+static Predictor preds[] = {
+  { "bimodal", bimodal_predict, bimodal_update },
+  { "gshare", gshare_predict, gshare_update },
+  { "TAGE-lite", tage_predict, tage_update },
+};
+
+// ---------------- BTB and RAS ----------------
+
+#define BTB_SIZE CONFIG_BPSIM_BTB_ENTRIES
+#define RAS_DEPTH CONFIG_BPSIM_RAS_DEPTH
+
+static_assert((BTB_SIZE & (BTB_SIZE - 1)) == 0, "BPSIM_BTB_ENTRIES must be a power of 2");
+
+static struct {
+  vaddr_t pc;
+  vaddr_t target;
+} btb[BTB_SIZE];
+static uint64_t btb_lookup = 0, btb_miss = 0;
+
+// the RAS is circular, and overflowing entries overwrite the oldest ones
+static vaddr_t ras[RAS_DEPTH];
+static int ras_top = 0;
+static uint64_t nr_ret = 0, ras_miss = 0;
+
+static void btb_access(vaddr_t pc, vaddr_t target) {
+  uint32_t i = (pc >> 2) & (BTB_SIZE - 1);
+  btb_lookup ++;
+  if (btb[i].pc != pc || btb[i].target != target) {
+    btb_miss ++;
+    btb[i].pc = pc;
+    btb[i].target = target;
+  }
+}
+
+void bpsim_branch(vaddr_t pc, bool taken, vaddr_t target) {
+  nr_branch ++;
+  for (int i = 0; i < ARRLEN(preds); i ++) {
+    if (preds[i].predict(pc) != taken) preds[i].nr_miss ++;
+    preds[i].update(pc, taken);
+  }
+  if (taken) btb_access(pc, target);
+}
+
+void bpsim_jump(Decode *s) {
+  nr_jump ++;
+  switch (isa_jump_type(s)) {
+    case INST_JUMP_RET:
+      nr_ret ++;
+      ras_top = (ras_top + RAS_DEPTH - 1) % RAS_DEPTH;
+      if (ras[ras_top] != s->dnpc) ras_miss ++;
+      return;
+    case INST_JUMP_CALL:
+      ras[ras_top] = s->snpc;
+      ras_top = (ras_top + 1) % RAS_DEPTH;
+      break;
+  }
+  btb_access(s->pc, s->dnpc);
+}
+
+uint64_t bpsim_nr_miss() {
+  return preds[ARRLEN(preds) - 1].nr_miss + btb_miss + ras_miss;
+}
+
+static inline double mpki(uint64_t miss) {
+  extern uint64_t g_nr_guest_inst;
+  return (g_nr_guest_inst ? miss * 1000.0 / g_nr_guest_inst : 0);
+}
+
+void bpsim_report() {
+  Log("branch predictors: %" PRIu64 " conditional branches, %" PRIu64 " jumps", nr_branch, nr_jump);
+  for (int i = 0; i < ARRLEN(preds); i ++) {
+    Log("%-10s %12" PRIu64 " misses, accuracy = %7.3f%%, MPKI = %.3f", preds[i].name, preds[i].nr_miss,
+        (nr_branch ? (nr_branch - preds[i].nr_miss) * 100.0 / nr_branch : 0), mpki(preds[i].nr_miss));
+  }
+  Log("%-10s %12" PRIu64 " misses of %" PRIu64 " taken branches and jumps, MPKI = %.3f",
+      "BTB", btb_miss, btb_lookup, mpki(btb_miss));
+  Log("%-10s %12" PRIu64 " misses of %" PRIu64 " returns, MPKI = %.3f", "RAS", ras_miss, nr_ret, mpki(ras_miss));
+}
+
+void init_bpsim() {
+  // weakly taken
+  memset(bimodal, 2, sizeof(bimodal));
+  memset(gshare, 2, sizeof(gshare));
+  memset(tage_base, 2, sizeof(tage_base));
+  for (int t = 0; t < TAGE_NR_TABLE; t ++) {
+    for (int i = 0; i < TAGE_SIZE; i ++) tage[t][i].tag = -1;
+  }
+}
+#endif
@@ -0,0 +1,40 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/callstack.h>
+
+#ifdef CONFIG_CALLSTACK
+CallStack g_callstack = { .depth = 1 };
+
+void callstack_step(Decode *s) {
+  CallStack *c = &g_callstack;
+  c->jump = isa_jump_type(s);
+  switch (c->jump) {
+    case INST_JUMP_CALL:
+      if (c->depth < CALLSTACK_MAX_DEPTH) c->entry[c->depth] = s->dnpc;
+      c->depth ++;
+      break;
+    case INST_JUMP_RET:
+      if (c->depth > 1) c->depth --;
+      break;
+  }
+}
+
+void init_callstack() {
+  g_callstack.entry[0] = cpu.pc;
+}
+#endif
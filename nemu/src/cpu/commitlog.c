@@ -0,0 +1,120 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <cpu/commitlog.h>
+#include <commitlog-def.h>
+#include <zlib.h>
+
+#ifdef CONFIG_COMMITLOG
+static FILE *clog_fp = NULL;
+static uint8_t chunk_buf[CLOG_CHUNK_SIZE];
+static uint8_t zbuf[CLOG_CHUNK_SIZE];
+static uint8_t *chunk_p = chunk_buf;
+static ClogChunkHeader chunk = {};
+static uint64_t nr_inst = 0;
+
+// the values the records are delta-encoded against
+static vaddr_t last_pc = 0;
+static vaddr_t last_addr = 0;
+static word_t last_val[CLOG_NR_REG] = {};
+
+// the data access of the current instruction
+static uint8_t mem_flag = 0;
+static vaddr_t mem_addr = 0;
+static word_t mem_data = 0;
+
+static void chunk_flush() {
+  if (chunk.nr_inst == 0) return;
+  chunk.size = chunk_p - chunk_buf;
+  uLongf zsize = sizeof(zbuf);
+  // store the records as is if they do not shrink
+  bool ok = compress2(zbuf, &zsize, chunk_buf, chunk.size, Z_BEST_SPEED) == Z_OK &&
+    zsize < chunk.size;
+  chunk.zsize = (ok ? zsize : 0);
+  fwrite(&chunk, sizeof(chunk), 1, clog_fp);
+  fwrite(ok ? zbuf : chunk_buf, ok ? zsize : chunk.size, 1, clog_fp);
+
+  chunk = (ClogChunkHeader) { .first_inst = nr_inst };
+  chunk_p = chunk_buf;
+  last_pc = 0;
+  last_addr = 0;
+  memset(last_val, 0, sizeof(last_val));
+}
+
+static inline uint8_t* put_delta(uint8_t *p, word_t now, word_t last) {
+  return clog_put_varint(p, clog_zigzag((sword_t)(now - last)));
+}
+
+// keep only the last data access if an instruction performs several ones,
+// and ignore the accesses of the monitor, such as `x` and watchpoints
+void commitlog_mem(vaddr_t addr, int len, word_t data, bool is_store) {
+  if (clog_fp == NULL || !g_inst_exec) return;
+  mem_flag = (is_store ? CLOG_STORE : CLOG_LOAD) | ((__builtin_ctz(len)) << CLOG_LEN_SHIFT);
+  mem_addr = addr;
+  mem_data = (len < 8 ? data & BITMASK(len * 8) : data); // a store passes the whole register
+}
+
+void commitlog_commit(Decode *s) {
+  if (clog_fp == NULL) return;
+  int rd = isa_difftest_commit_reg(s);
+  uint8_t *p = chunk_p;
+  uint8_t *flag = p ++;
+  *flag = mem_flag | (rd >= 0 ? CLOG_RD : 0);
+
+  p = put_delta(p, s->pc, last_pc);
+  last_pc = s->pc;
+  uint32_t inst = s->isa.inst.val;
+  memcpy(p, &inst, sizeof(inst));
+  p += sizeof(inst);
+
+  if (rd >= 0) {
+    assert(rd < CLOG_NR_REG);
+    word_t val = ((word_t *)&cpu)[rd];
+    *p ++ = rd;
+    p = put_delta(p, val, last_val[rd]);
+    last_val[rd] = val;
+  }
+  if (mem_flag) {
+    p = put_delta(p, mem_addr, last_addr);
+    p = clog_put_varint(p, mem_data);
+    last_addr = mem_addr;
+    mem_flag = 0;
+  }
+
+  chunk_p = p;
+  chunk.nr_inst ++;
+  nr_inst ++;
+  if (chunk_p + CLOG_MAX_RECORD > chunk_buf + CLOG_CHUNK_SIZE) chunk_flush();
+}
+
+static void close_commitlog() {
+  chunk_flush();
+  fclose(clog_fp);
+}
+
+void init_commitlog(const char *file) {
+  if (file == NULL) return;
+  clog_fp = fopen(file, "wb");
+  Assert(clog_fp, "Can not open '%s'", file);
+  ClogHeader h = { .version = CLOG_VERSION, .word_size = sizeof(word_t) };
+  memcpy(h.magic, CLOG_MAGIC, sizeof(h.magic));
+  fwrite(&h, sizeof(h), 1, clog_fp);
+  atexit(close_commitlog);
+  Log("Commit log is written to %s", file);
+}
+#endif
@@ -16,6 +16,16 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <cpu/commitlog.h>
+#include <cpu/callstack.h>
+#include <cpu/profile.h>
+#include <cpu/ftrace.h>
+#include <cpu/inst-stat.h>
+#include <memory/cachesim.h>
+#include <memory/heatmap.h>
+#include <cpu/bpsim.h>
+#include <cpu/timing.h>
+#include <cpu/simpoint.h>
 #include <locale.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -27,27 +37,49 @@
 
 CPU_state cpu = {};
 uint64_t g_nr_guest_inst = 0;
+bool g_inst_exec = false;
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
 
 void device_update();
 void wp_check(vaddr_t pc);
+void bp_check(vaddr_t pc);
+extern int nr_bp;
 
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
+  SELF_PROF_BEGIN(SP_TRACE);
 #ifdef CONFIG_ITRACE_COND
   if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
 #endif
   if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
-  IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
+  IFDEF(CONFIG_COMMITLOG, commitlog_commit(_this));
+  IFDEF(CONFIG_CALLSTACK, callstack_step(_this));
+  IFDEF(CONFIG_PROFILE, profile_step(_this));
+  IFDEF(CONFIG_FTRACE, ftrace_step(_this));
+  IFDEF(CONFIG_INST_STAT, inst_stat_step(_this));
+  IFDEF(CONFIG_TIMING, timing_step(_this));
+  IFDEF(CONFIG_SIMPOINT, simpoint_step(_this));
+  SELF_PROF_END(SP_TRACE);
+  SELF_PROF_BEGIN(SP_DIFFTEST);
+  IFDEF(CONFIG_DIFFTEST, MUXDEF(CONFIG_DIFFTEST_PIPELINE,
+        difftest_commit(_this, dnpc), difftest_step(_this->pc, dnpc)));
+  SELF_PROF_END(SP_DIFFTEST);
   IFDEF(CONFIG_WATCHPOINT, wp_check(_this->pc));
+  // stop before executing the instruction at a breakpoint
+  IFDEF(CONFIG_BREAKPOINT, if (unlikely(nr_bp > 0)) bp_check(dnpc));
 }
 
 static void exec_once(Decode *s, vaddr_t pc) {
   s->pc = pc;
   s->snpc = pc;
+  SELF_PROF_BEGIN(SP_EXEC_ONCE);
+  g_inst_exec = true;
   isa_exec_once(s);
+  g_inst_exec = false;
+  SELF_PROF_END(SP_EXEC_ONCE);
   cpu.pc = s->dnpc;
 #ifdef CONFIG_ITRACE
+  SELF_PROF_SCOPE(SP_TRACE);
   char *p = s->logbuf;
   p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
   int ilen = s->snpc - s->pc;
@@ -91,6 +123,14 @@ static void statistic() {
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_PROFILE, profile_report());
+  IFDEF(CONFIG_FTRACE, ftrace_report());
+  IFDEF(CONFIG_INST_STAT, inst_stat_report());
+  IFDEF(CONFIG_CACHESIM, cachesim_report());
+  IFDEF(CONFIG_MEM_HEATMAP, heatmap_report());
+  IFDEF(CONFIG_BPSIM, bpsim_report());
+  IFDEF(CONFIG_TIMING, timing_report());
+  IFDEF(CONFIG_SELF_PROFILE, self_prof_report());
 }
 
 void assert_fail_msg() {
@@ -110,7 +150,10 @@ void cpu_exec(uint64_t n) {
 
   uint64_t timer_start = get_time();
 
+  SELF_PROF_BEGIN(SP_EXECUTE);
   execute(n);
+  difftest_sync();
+  SELF_PROF_END(SP_EXECUTE);
 
   uint64_t timer_end = get_time();
   g_timer += timer_end - timer_start;
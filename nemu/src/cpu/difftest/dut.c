@@ -17,9 +17,26 @@
 
 #include <isa.h>
 #include <cpu/cpu.h>
+#include <cpu/decode.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 #include <utils.h>
 #include <difftest-def.h>
+#ifdef CONFIG_DIFFTEST_SHM
+#include <difftest-shm.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#endif
+#ifdef CONFIG_DIFFTEST_PIPELINE
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
 
 void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction) = NULL;
 void (*ref_difftest_regcpy)(void *dut, bool direction) = NULL;
@@ -30,6 +47,585 @@ void (*ref_difftest_raise_intr)(uint64_t NO) = NULL;
 
 static bool is_skip_ref = false;
 static int skip_dut_nr_inst = 0;
+static int skip_dut_nr_ref = 0;
+
+#ifdef CONFIG_DIFFTEST_SHM
+/* REF runs in the server process, and the ref_difftest_* functions
+ * forward the calls through the shared memory. If the server dies,
+ * the rest of the calls are ignored and DUT is aborted.
+ */
+static DifftestShm *shm = NULL;
+static uint32_t shm_seq = 0;
+static pid_t ref_pid = 0;
+static bool ref_dead = false;
+static uint64_t ref_features = 0;
+
+static void shm_call(int cmd) {
+  if (ref_dead) return;
+  shm->cmd = cmd;
+  shm_ring(&shm->req_seq, ++ shm_seq);
+  while (!shm_wait(&shm->resp_seq, shm_seq, 100)) {
+    int status;
+    if (waitpid(ref_pid, &status, WNOHANG) != ref_pid) continue;
+    if (WIFSIGNALED(status)) Log("REF is killed by signal %d", WTERMSIG(status));
+    else Log("REF exits with status %d", WEXITSTATUS(status));
+    ref_dead = true;
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = cpu.pc;
+    return;
+  }
+}
+
+static void shm_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
+  while (n > 0) {
+    size_t len = (n > SHM_DATA_SIZE ? SHM_DATA_SIZE : n);
+    if (direction == DIFFTEST_TO_REF) memcpy(shm->data, buf, len);
+    shm->addr = addr;
+    shm->n = len;
+    shm->direction = direction;
+    shm_call(SHM_CMD_MEMCPY);
+    if (direction == DIFFTEST_TO_DUT) memcpy(buf, shm->data, len);
+    addr += len;
+    buf += len;
+    n -= len;
+  }
+}
+
+static void shm_regcpy(void *dut, bool direction) {
+  if (direction == DIFFTEST_TO_REF) memcpy(shm->data, dut, DIFFTEST_REG_SIZE);
+  shm->direction = direction;
+  shm_call(SHM_CMD_REGCPY);
+  if (direction == DIFFTEST_TO_DUT) memcpy(dut, shm->data, DIFFTEST_REG_SIZE);
+}
+
+static void shm_exec(uint64_t n) {
+  shm->n = n;
+  shm_call(SHM_CMD_EXEC);
+}
+
+static bool shm_run_to_pc(vaddr_t pc) {
+  shm->addr = pc;
+  shm_call(SHM_CMD_RUN_TO_PC);
+  return !ref_dead && shm->arg;
+}
+
+static void shm_raise_intr(uint64_t NO) {
+  shm->arg = NO;
+  shm_call(SHM_CMD_RAISE_INTR);
+}
+
+static void shm_init_ref(int port) {
+  shm->arg = port;
+  shm_call(SHM_CMD_INIT);
+}
+
+static size_t shm_dirty(paddr_t *pages, size_t max) {
+  size_t n = 0;
+  while (n < max) {
+    size_t len = max - n;
+    if (len > SHM_DATA_SIZE / sizeof(paddr_t)) len = SHM_DATA_SIZE / sizeof(paddr_t);
+    shm->arg = len;
+    shm->n = 0;
+    shm_call(SHM_CMD_DIRTY);
+    memcpy(pages + n, shm->data, shm->n * sizeof(paddr_t));
+    n += shm->n;
+    if (shm->n < len) break;
+  }
+  return n;
+}
+
+static void shm_memhash(const paddr_t *pages, uint64_t *hash, size_t n) {
+  // the hashes follow the pages, see tools/difftest-shm
+  const size_t chunk = SHM_DATA_SIZE / (2 * sizeof(uint64_t));
+  while (n > 0) {
+    size_t len = (n > chunk ? chunk : n);
+    memcpy(shm->data, pages, len * sizeof(paddr_t));
+    shm->n = len;
+    shm_call(SHM_CMD_MEMHASH);
+    memcpy(hash, shm->data + len * sizeof(uint64_t), len * sizeof(uint64_t));
+    pages += len;
+    hash += len;
+    n -= len;
+  }
+}
+
+// start the server of REF, and return a handle for ref_sym()
+static void* shm_open_ref(const char *ref_so_file) {
+  int fd = syscall(SYS_memfd_create, "nemu-difftest", 0);
+  Assert(fd >= 0, "failed to create the shared memory for difftest");
+  int ret = ftruncate(fd, sizeof(DifftestShm));
+  assert(ret == 0);
+  shm = mmap(NULL, sizeof(DifftestShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(shm != MAP_FAILED);
+
+  char *home = getenv("NEMU_HOME");
+  Assert(home != NULL, "NEMU_HOME is not set");
+  char server[PATH_MAX], fd_str[16];
+  snprintf(server, sizeof(server), "%s/tools/difftest-shm/build/difftest-shm", home);
+  snprintf(fd_str, sizeof(fd_str), "%d", fd);
+
+  ref_pid = fork();
+  Assert(ref_pid >= 0, "failed to fork the process of REF");
+  if (ref_pid == 0) {
+    // kill the server with DUT
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    execl(server, server, fd_str, ref_so_file, NULL);
+    perror("exec difftest-shm");
+    _exit(1);
+  }
+  close(fd);
+
+  shm_call(SHM_CMD_HELLO);
+  Assert(!ref_dead, "failed to start %s", server);
+  ref_features = shm->arg;
+  Log("REF runs in process %d", ref_pid);
+  return shm;
+}
+
+static void* shm_sym(const char *name) {
+  static const struct { const char *name; void *fn; } syms[] = {
+    { "difftest_memcpy", shm_memcpy },
+    { "difftest_regcpy", shm_regcpy },
+    { "difftest_exec", shm_exec },
+    { "difftest_raise_intr", shm_raise_intr },
+    { "difftest_init", shm_init_ref },
+    { "difftest_dirty", shm_dirty },
+    { "difftest_memhash", shm_memhash },
+    { "difftest_run_to_pc", shm_run_to_pc },
+  };
+  if (!(ref_features & SHM_HAS_MEMCHECK) &&
+      (!strcmp(name, "difftest_dirty") || !strcmp(name, "difftest_memhash"))) {
+    return NULL;
+  }
+  if (!(ref_features & SHM_HAS_RUN_TO_PC) && !strcmp(name, "difftest_run_to_pc")) return NULL;
+  for (int i = 0; i < ARRLEN(syms); i ++) {
+    if (!strcmp(name, syms[i].name)) return syms[i].fn;
+  }
+  return NULL;
+}
+#endif
+
+static void* ref_sym(void *handle, const char *name) {
+  return MUXDEF(CONFIG_DIFFTEST_SHM, shm_sym(name), dlsym(handle, name));
+}
+
+#if defined(CONFIG_DIFFTEST_BATCH) || defined(CONFIG_DIFFTEST_MEMCHECK)
+/* REF tracks the pages written by itself, which are not the same as
+ * those written by DUT once they diverge. Fetching them clears the marks
+ * in REF, so they are merged into the dirty map of DUT for every user.
+ */
+static size_t (*ref_difftest_dirty)(paddr_t *pages, size_t max) = NULL;
+static paddr_t pages[NR_PMEM_PAGE];
+
+static void ref_dirty_merge() {
+  if (ref_difftest_dirty == NULL) return;
+  size_t n = ref_difftest_dirty(pages, NR_PMEM_PAGE);
+  for (size_t i = 0; i < n; i ++) {
+    pmem_dirty[(pages[i] - PMEM_LEFT) >> PAGE_SHIFT] |=
+      (1u << DIRTY_DIFFTEST_SNAPSHOT) | (1u << DIRTY_DIFFTEST_MEMCHECK);
+  }
+}
+#endif
+
+#ifdef CONFIG_DIFFTEST_MEMCHECK
+/* Both sides track the pages written since the last check. Only the
+ * hashes of these pages are transferred, and a page is fetched from REF
+ * only if its hash mismatches. REF should hash pages with hash64().
+ */
+static void (*ref_difftest_memhash)(const paddr_t *pages, uint64_t *hash, size_t n) = NULL;
+static uint64_t memcheck_nr_inst = 0;
+
+static void memcheck(vaddr_t pc) {
+  static uint64_t ref_hash[NR_PMEM_PAGE];
+  static uint8_t ref_page[PAGE_SIZE];
+
+  ref_dirty_merge();
+  size_t n = 0;
+  for (int i = 0; i < NR_PMEM_PAGE; i ++) {
+    if (paddr_is_dirty(i, DIRTY_DIFFTEST_MEMCHECK)) pages[n ++] = PMEM_LEFT + i * PAGE_SIZE;
+  }
+  paddr_dirty_clear(DIRTY_DIFFTEST_MEMCHECK);
+  if (n == 0) return;
+
+  ref_difftest_memhash(pages, ref_hash, n);
+  for (size_t i = 0; i < n; i ++) {
+    uint8_t *dut_page = guest_to_host(pages[i]);
+    if (hash64(dut_page, PAGE_SIZE) == ref_hash[i]) continue;
+
+    ref_difftest_memcpy(pages[i], ref_page, PAGE_SIZE, DIFFTEST_TO_DUT);
+    int nr_diff = 0, first = -1;
+    for (int j = 0; j < PAGE_SIZE; j ++) {
+      if (ref_page[j] != dut_page[j]) {
+        if (first == -1) first = j;
+        nr_diff ++;
+      }
+    }
+    if (nr_diff == 0) continue; // REF hashes the page in a different way
+    Log("memory at " FMT_PADDR " is different before executing instruction at pc = " FMT_WORD
+        ", right = 0x%02x, wrong = 0x%02x, %d byte(s) are different in this page",
+        pages[i] + first, pc, ref_page[first], dut_page[first], nr_diff);
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = pc;
+    return;
+  }
+}
+
+// called when REF agrees with DUT after `nr_inst` more instructions
+static void memcheck_step(int nr_inst, vaddr_t pc) {
+  memcheck_nr_inst += nr_inst;
+  if (memcheck_nr_inst < CONFIG_DIFFTEST_MEMCHECK_INTERVAL || ref_difftest_memhash == NULL) return;
+  memcheck_nr_inst = 0;
+  memcheck(pc);
+}
+
+static void memcheck_init(void *handle) {
+  ref_difftest_memhash = ref_sym(handle, "difftest_memhash");
+  if (ref_difftest_dirty == NULL || ref_difftest_memhash == NULL) {
+    ref_difftest_memhash = NULL;
+    Log("REF does not support memory checking, which is turned off");
+    return;
+  }
+  // only the image is copied to REF during initialization, but
+  // a page will be compared as a whole once it is written
+  ref_difftest_memcpy(PMEM_LEFT, guest_to_host(PMEM_LEFT), CONFIG_MSIZE, DIFFTEST_TO_REF);
+  ref_dirty_merge();
+  paddr_dirty_clear(DIRTY_DIFFTEST_MEMCHECK);
+  Log("Memory written is checked every %d instructions", CONFIG_DIFFTEST_MEMCHECK_INTERVAL);
+}
+#endif
+
+#ifdef CONFIG_DIFFTEST_BATCH
+/* DUT and REF run a batch of instructions before REF is checked.
+ * Only the digest of the DUT state after each instruction is kept.
+ * The states of both sides at the last agreeing point (a checkpoint)
+ * are kept by DUT, so that REF can be rolled back to it when the batch
+ * mismatches. The first diverging instruction is then found by bisection,
+ * which costs O(log(batch size)) re-executions of REF.
+ */
+typedef struct {
+  vaddr_t pc;
+  uint64_t digest;
+} BatchRecord;
+
+static BatchRecord batch[CONFIG_DIFFTEST_BATCH_SIZE];
+static int batch_nr = 0;
+static CPU_state snap_cpu;
+static uint8_t *snap_mem = NULL;
+
+static inline uint64_t reg_digest(CPU_state *r) {
+  // REF only transfers the first DIFFTEST_REG_SIZE bytes
+  return hash64(r, DIFFTEST_REG_SIZE);
+}
+
+static void checkpoint() {
+  snap_cpu = cpu;
+  // start tracking the pages written by REF from here
+  ref_dirty_merge();
+  for (int i = 0; i < NR_PMEM_PAGE; i ++) {
+    if (paddr_is_dirty(i, DIRTY_DIFFTEST_SNAPSHOT)) {
+      memcpy(snap_mem + i * PAGE_SIZE, guest_to_host(PMEM_LEFT + i * PAGE_SIZE), PAGE_SIZE);
+    }
+  }
+  paddr_dirty_clear(DIRTY_DIFFTEST_SNAPSHOT);
+  batch_nr = 0;
+}
+
+// restore the pages written by either side since the checkpoint, or
+// the whole memory if REF can not tell the pages written by itself
+static void ref_rollback() {
+  if (ref_difftest_dirty == NULL) {
+    ref_difftest_memcpy(PMEM_LEFT, snap_mem, CONFIG_MSIZE, DIFFTEST_TO_REF);
+  } else {
+    ref_dirty_merge();
+    for (int i = 0; i < NR_PMEM_PAGE; i ++) {
+      if (paddr_is_dirty(i, DIRTY_DIFFTEST_SNAPSHOT)) {
+        ref_difftest_memcpy(PMEM_LEFT + i * PAGE_SIZE, snap_mem + i * PAGE_SIZE, PAGE_SIZE, DIFFTEST_TO_REF);
+      }
+    }
+  }
+  ref_difftest_regcpy(&snap_cpu, DIFFTEST_TO_REF);
+}
+
+static bool ref_run_and_check(int n, CPU_state *ref_r) {
+  ref_difftest_exec(n);
+  ref_difftest_regcpy(ref_r, DIFFTEST_TO_DUT);
+  return reg_digest(ref_r) == batch[n - 1].digest;
+}
+
+static void batch_bisect() {
+  CPU_state ref_r;
+  // REF agrees with DUT after `lo` instructions, but not after `hi` instructions
+  int lo = 0, hi = batch_nr;
+  while (hi - lo > 1) {
+    int mid = lo + (hi - lo) / 2;
+    ref_rollback();
+    if (ref_run_and_check(mid, &ref_r)) lo = mid;
+    else hi = mid;
+  }
+
+  ref_rollback();
+  ref_run_and_check(hi, &ref_r);
+  vaddr_t pc = batch[hi - 1].pc;
+  Log("The first diverging instruction is at pc = " FMT_WORD ", %d instruction(s) after "
+      "the last checkpoint", pc, hi);
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = pc;
+  if (reg_digest(&cpu) == batch[hi - 1].digest) {
+    // the current DUT state is the one after the diverging instruction
+    isa_difftest_checkregs(&ref_r, pc);
+    isa_reg_display();
+  } else {
+    CPU_state dut_r = cpu;
+    cpu = ref_r;
+    Log("Registers of REF after executing the diverging instruction:");
+    isa_reg_display();
+    cpu = dut_r;
+  }
+  batch_nr = 0;
+}
+
+// check the pending instructions in the batch
+static void batch_flush() {
+  if (batch_nr == 0) return;
+  CPU_state ref_r;
+  if (ref_run_and_check(batch_nr, &ref_r)) {
+    IFDEF(CONFIG_DIFFTEST_MEMCHECK, memcheck_step(batch_nr, ref_r.pc));
+    checkpoint();
+  }
+  else batch_bisect();
+}
+
+static void batch_init() {
+  snap_mem = malloc(CONFIG_MSIZE);
+  assert(snap_mem);
+  memcpy(snap_mem, guest_to_host(PMEM_LEFT), CONFIG_MSIZE);
+  snap_cpu = cpu;
+  ref_dirty_merge();
+  paddr_dirty_clear(DIRTY_DIFFTEST_SNAPSHOT);
+  Log("Differential testing is performed every %d instructions", CONFIG_DIFFTEST_BATCH_SIZE);
+}
+#endif
+
+#ifdef CONFIG_DIFFTEST_PIPELINE
+/* DUT pushes records into a single-producer single-consumer ring, and
+ * REF is only driven by `ref_thread`, which checks the records one by one.
+ * A skip request also travels through the ring to keep its order with
+ * the instructions around it.
+ */
+enum { REC_COMMIT, REC_SKIP_REF, REC_SKIP_DUT };
+
+typedef struct {
+  int type;
+  union {
+    struct { // REC_COMMIT
+      vaddr_t pc, npc;
+      int reg; // see isa_difftest_commit_reg()
+      int st_len; // 0 if there is no store to pmem
+      word_t reg_val;
+      paddr_t st_addr;
+      word_t st_data;
+    };
+    CPU_state regs; // REC_SKIP_REF, the DUT state after the skipped instruction
+    struct { int nr_ref, nr_dut; }; // REC_SKIP_DUT
+  };
+} CommitRecord;
+
+#define RING_SIZE 4096
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of 2");
+
+static CommitRecord ring[RING_SIZE];
+// free-running indices, `ring_head` is written by DUT, `ring_tail` by ref_thread
+static _Atomic uint32_t ring_head = 0, ring_tail = 0;
+
+// written by ref_thread before `ref_failed` is set
+static char ref_fail_msg[256];
+static vaddr_t ref_fail_pc;
+static uint32_t ref_cur_idx, ref_fail_idx;  // indices of records in the ring
+static _Atomic bool ref_failed = false;
+
+static struct { paddr_t addr; int len; word_t data; } cur_store = {};
+
+void difftest_record_store(paddr_t addr, int len, word_t data) {
+  cur_store.addr = addr;
+  cur_store.len = len;
+  cur_store.data = data;
+}
+
+static void ref_fail(vaddr_t pc, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(ref_fail_msg, sizeof(ref_fail_msg), fmt, ap);
+  va_end(ap);
+  ref_fail_pc = pc;
+  ref_fail_idx = ref_cur_idx;
+  atomic_store_explicit(&ref_failed, true, memory_order_release);
+}
+
+static void ref_check_commit(CommitRecord *r, CPU_state *ref_r) {
+  if (ref_r->pc != r->npc) {
+    ref_fail(r->pc, "pc is different after executing instruction at pc = " FMT_WORD
+        ", right = " FMT_WORD ", wrong = " FMT_WORD, r->pc, ref_r->pc, r->npc);
+  } else if (r->reg >= 0 && ((word_t *)ref_r)[r->reg] != r->reg_val) {
+    ref_fail(r->pc, "register #%d is different after executing instruction at pc = " FMT_WORD
+        ", right = " FMT_WORD ", wrong = " FMT_WORD, r->reg, r->pc, ((word_t *)ref_r)[r->reg], r->reg_val);
+  } else if (r->st_len > 0) {
+    word_t ref_data = 0;
+    ref_difftest_memcpy(r->st_addr, &ref_data, r->st_len, DIFFTEST_TO_DUT);
+    word_t mask = (r->st_len >= sizeof(word_t) ? (word_t)-1 : ((word_t)1 << (r->st_len * 8)) - 1);
+    if (ref_data != (r->st_data & mask)) {
+      ref_fail(r->pc, "memory at " FMT_PADDR " is different after executing instruction at pc = " FMT_WORD
+          ", right = " FMT_WORD ", wrong = " FMT_WORD, r->st_addr, r->pc, ref_data, r->st_data & mask);
+    }
+  }
+}
+
+static void ref_process(CommitRecord *r, int *nr_catch_up) {
+  CPU_state ref_r;
+  switch (r->type) {
+    case REC_SKIP_REF:
+      ref_difftest_regcpy(&r->regs, DIFFTEST_TO_REF);
+      *nr_catch_up = 0;
+      return;
+    case REC_SKIP_DUT:
+      *nr_catch_up += r->nr_dut;
+      for (int i = 0; i < r->nr_ref; i ++) ref_difftest_exec(1);
+      return;
+  }
+
+  if (*nr_catch_up > 0) {
+    ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+    if (ref_r.pc == r->npc) {
+      *nr_catch_up = 0;
+      ref_check_commit(r, &ref_r);
+    } else if (-- *nr_catch_up == 0) {
+      ref_fail(r->pc, "can not catch up with ref.pc = " FMT_WORD " at pc = " FMT_WORD, ref_r.pc, r->pc);
+    }
+    return;
+  }
+
+  ref_difftest_exec(1);
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  ref_check_commit(r, &ref_r);
+}
+
+static void* ref_thread(void *arg) {
+  int nr_catch_up = 0;
+  for (uint32_t tail = 0; ; tail ++) {
+    // spin for a while before sleeping, since DUT is usually busy
+    for (int spin = 0; atomic_load_explicit(&ring_head, memory_order_acquire) == tail; spin ++) {
+      if (spin > 1024) usleep(100);
+      else sched_yield();
+    }
+    // keep draining the ring after a failure, so that DUT never blocks
+    if (!atomic_load_explicit(&ref_failed, memory_order_relaxed)) {
+      ref_cur_idx = tail;
+      ref_process(&ring[tail % RING_SIZE], &nr_catch_up);
+    }
+    atomic_store_explicit(&ring_tail, tail + 1, memory_order_release);
+  }
+  return NULL;
+}
+
+static CommitRecord* ring_alloc() {
+  uint32_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+  while (head - atomic_load_explicit(&ring_tail, memory_order_acquire) == RING_SIZE) sched_yield();
+  return &ring[head % RING_SIZE];
+}
+
+static void ring_push() {
+  uint32_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+  atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+}
+
+static void check_ref_failed() {
+  static bool reported = false;
+  if (likely(!atomic_load_explicit(&ref_failed, memory_order_acquire)) || reported) return;
+  reported = true;
+  Log("%s", ref_fail_msg);
+  // DUT keeps running while REF checks the records behind it
+  Log("The divergence is found %u record(s) late, the current pc = " FMT_WORD,
+      atomic_load_explicit(&ring_head, memory_order_relaxed) - ref_fail_idx - 1, cpu.pc);
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = ref_fail_pc;
+}
+
+void difftest_commit(struct Decode *s, vaddr_t npc) {
+  check_ref_failed();
+  CommitRecord *r = ring_alloc();
+  if (is_skip_ref) {
+    r->type = REC_SKIP_REF;
+    r->regs = cpu;
+    is_skip_ref = false;
+  } else {
+    r->type = REC_COMMIT;
+    r->pc = s->pc;
+    r->npc = npc;
+    r->reg = isa_difftest_commit_reg(s);
+    r->reg_val = (r->reg >= 0 ? ((word_t *)&cpu)[r->reg] : 0);
+    r->st_len = cur_store.len;
+    r->st_addr = cur_store.addr;
+    r->st_data = cur_store.data;
+  }
+  cur_store.len = 0;
+  ring_push();
+}
+
+static void pipeline_init() {
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, ref_thread, NULL);
+  Assert(ret == 0, "failed to create the thread of REF");
+  Log("Differential testing: REF runs on a separate thread");
+}
+#endif
+
+#ifdef CONFIG_DIFFTEST_FAST_FORWARD
+static bool is_fast_forward = true;
+// REF can not run freely through the instructions skipped by it
+static bool is_ff_skipped = false;
+static bool (*ref_difftest_run_to_pc)(vaddr_t pc) = NULL;
+
+static void checkregs(CPU_state *ref, vaddr_t pc);
+
+// copy the pages written by DUT since REF was initialized, or all of them
+static void copy_dut_state(bool all_pages) {
+  for (int i = 0; i < NR_PMEM_PAGE; i ++) {
+    if (all_pages || paddr_is_dirty(i, DIRTY_DIFFTEST_FAST_FORWARD)) {
+      paddr_t addr = PMEM_LEFT + i * PAGE_SIZE;
+      ref_difftest_memcpy(addr, guest_to_host(addr), PAGE_SIZE, DIFFTEST_TO_REF);
+    }
+  }
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  Log("Copy the state of DUT to REF at pc = " FMT_WORD ", start checking", cpu.pc);
+}
+
+// DUT has reached the region of interest, and REF should catch up
+static void fast_forward_end() {
+  is_fast_forward = false;
+  if (ref_difftest_run_to_pc == NULL) copy_dut_state(false);
+  else if (is_ff_skipped) {
+    Log("REF can not run freely through the instructions skipped by it");
+    copy_dut_state(false);
+  } else if (!ref_difftest_run_to_pc(cpu.pc)) {
+    // REF may have written other pages on its way
+    Log("REF fails to run to pc = " FMT_WORD, cpu.pc);
+    copy_dut_state(true);
+  } else {
+    CPU_state ref_r;
+    ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+    Log("REF has run to pc = " FMT_WORD ", start checking", ref_r.pc);
+    checkregs(&ref_r, cpu.pc);
+  }
+  IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
+}
+
+static void fast_forward_init(void *handle) {
+  ref_difftest_run_to_pc = ref_sym(handle, "difftest_run_to_pc");
+  paddr_dirty_clear(DIRTY_DIFFTEST_FAST_FORWARD);
+  Log("Differential testing starts at pc = " FMT_WORD ", REF will %s", (vaddr_t)CONFIG_DIFFTEST_START_PC,
+      ref_difftest_run_to_pc ? "run to it freely" : "copy the state of DUT");
+  if (cpu.pc == CONFIG_DIFFTEST_START_PC) is_fast_forward = false;
+}
+#endif
 
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
@@ -43,6 +639,7 @@ void difftest_skip_ref() {
   // will load that memory, we will encounter false negative. But such
   // situation is infrequent.
   skip_dut_nr_inst = 0;
+  skip_dut_nr_ref = 0;
 }
 
 // this is used to deal with instruction packing in QEMU.
@@ -52,33 +649,40 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+#ifdef CONFIG_DIFFTEST_PIPELINE
+  // REF is only accessed by ref_thread, which also tracks the catching up
+  CommitRecord *r = ring_alloc();
+  r->type = REC_SKIP_DUT;
+  r->nr_ref = nr_ref;
+  r->nr_dut = nr_dut;
+  ring_push();
+  return;
+#endif
+  // the current instruction is not finished, so REF runs in difftest_step()
   skip_dut_nr_inst += nr_dut;
-
-  while (nr_ref -- > 0) {
-    ref_difftest_exec(1);
-  }
+  skip_dut_nr_ref += nr_ref;
 }
 
 void init_difftest(char *ref_so_file, long img_size, int port) {
   assert(ref_so_file != NULL);
 
   void *handle;
-  handle = dlopen(ref_so_file, RTLD_LAZY);
+  handle = MUXDEF(CONFIG_DIFFTEST_SHM, shm_open_ref(ref_so_file), dlopen(ref_so_file, RTLD_LAZY));
   assert(handle);
 
-  ref_difftest_memcpy = dlsym(handle, "difftest_memcpy");
+  ref_difftest_memcpy = ref_sym(handle, "difftest_memcpy");
   assert(ref_difftest_memcpy);
 
-  ref_difftest_regcpy = dlsym(handle, "difftest_regcpy");
+  ref_difftest_regcpy = ref_sym(handle, "difftest_regcpy");
   assert(ref_difftest_regcpy);
 
-  ref_difftest_exec = dlsym(handle, "difftest_exec");
+  ref_difftest_exec = ref_sym(handle, "difftest_exec");
   assert(ref_difftest_exec);
 
-  ref_difftest_raise_intr = dlsym(handle, "difftest_raise_intr");
+  ref_difftest_raise_intr = ref_sym(handle, "difftest_raise_intr");
   assert(ref_difftest_raise_intr);
 
-  void (*ref_difftest_init)(int) = dlsym(handle, "difftest_init");
+  void (*ref_difftest_init)(int) = ref_sym(handle, "difftest_init");
   assert(ref_difftest_init);
 
   Log("Differential testing: %s", ANSI_FMT("ON", ANSI_FG_GREEN));
@@ -89,9 +693,17 @@ void init_difftest(char *ref_so_file, long img_size, int port) {
   ref_difftest_init(port);
   ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), img_size, DIFFTEST_TO_REF);
   ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+#if defined(CONFIG_DIFFTEST_BATCH) || defined(CONFIG_DIFFTEST_MEMCHECK)
+  ref_difftest_dirty = ref_sym(handle, "difftest_dirty");
+#endif
+  IFDEF(CONFIG_DIFFTEST_BATCH, batch_init());
+  IFDEF(CONFIG_DIFFTEST_PIPELINE, pipeline_init());
+  IFDEF(CONFIG_DIFFTEST_MEMCHECK, memcheck_init(handle));
+  IFDEF(CONFIG_DIFFTEST_FAST_FORWARD, fast_forward_init(handle));
 }
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
+  IFDEF(CONFIG_DIFFTEST_SHM, if (ref_dead) return);
   if (!isa_difftest_checkregs(ref, pc)) {
     nemu_state.state = NEMU_ABORT;
     nemu_state.halt_pc = pc;
@@ -102,11 +714,33 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
 void difftest_step(vaddr_t pc, vaddr_t npc) {
   CPU_state ref_r;
 
+#ifdef CONFIG_DIFFTEST_FAST_FORWARD
+  if (is_fast_forward) {
+    // the skip requests before the region of interest are meaningless,
+    // but REF can no longer run to it by itself
+    if (is_skip_ref) is_ff_skipped = true;
+    is_skip_ref = false;
+    skip_dut_nr_inst = 0;
+    skip_dut_nr_ref = 0;
+    if (npc == CONFIG_DIFFTEST_START_PC) fast_forward_end();
+    return;
+  }
+#endif
+
+  if (skip_dut_nr_ref > 0) {
+    // check the instructions before the current one
+    IFDEF(CONFIG_DIFFTEST_BATCH, batch_flush());
+    for (; skip_dut_nr_ref > 0; skip_dut_nr_ref --) {
+      ref_difftest_exec(1);
+    }
+  }
+
   if (skip_dut_nr_inst > 0) {
     ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
     if (ref_r.pc == npc) {
       skip_dut_nr_inst = 0;
       checkregs(&ref_r, npc);
+      IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
       return;
     }
     skip_dut_nr_inst --;
@@ -116,16 +750,37 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
   }
 
   if (is_skip_ref) {
+    // check the instructions before the skipped one
+    IFDEF(CONFIG_DIFFTEST_BATCH, batch_flush());
     // to skip the checking of an instruction, just copy the reg state to reference design
     ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
     is_skip_ref = false;
+    IFDEF(CONFIG_DIFFTEST_BATCH, checkpoint());
     return;
   }
 
+#ifdef CONFIG_DIFFTEST_BATCH
+  batch[batch_nr ++] = (BatchRecord) { .pc = pc, .digest = reg_digest(&cpu) };
+  if (batch_nr == CONFIG_DIFFTEST_BATCH_SIZE) batch_flush();
+  return;
+#endif
+
   ref_difftest_exec(1);
   ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
 
   checkregs(&ref_r, pc);
+  IFDEF(CONFIG_DIFFTEST_MEMCHECK, memcheck_step(1, npc));
+}
+
+void difftest_sync() {
+  IFDEF(CONFIG_DIFFTEST_BATCH, batch_flush());
+#ifdef CONFIG_DIFFTEST_PIPELINE
+  while (atomic_load_explicit(&ring_tail, memory_order_acquire) !=
+         atomic_load_explicit(&ring_head, memory_order_relaxed)) {
+    sched_yield();
+  }
+  check_ref_failed();
+#endif
 }
 #else
 void init_difftest(char *ref_so_file, long img_size, int port) { }
@@ -17,22 +17,59 @@
 #include <cpu/cpu.h>
 #include <difftest-def.h>
 #include <memory/paddr.h>
+#include <utils.h>
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
-  assert(0);
+  if (n == 0) return;
+  Assert(in_pmem(addr) && in_pmem(addr + n - 1),
+      "[" FMT_PADDR ", " FMT_PADDR ") is out of pmem", addr, (paddr_t)(addr + n));
+  if (direction == DIFFTEST_TO_REF) memcpy(guest_to_host(addr), buf, n);
+  else memcpy(buf, guest_to_host(addr), n);
 }
 
 __EXPORT void difftest_regcpy(void *dut, bool direction) {
-  assert(0);
+  // only the part of CPU_state shared with other REFs is transferred
+  if (direction == DIFFTEST_TO_REF) memcpy(&cpu, dut, DIFFTEST_REG_SIZE);
+  else memcpy(dut, &cpu, DIFFTEST_REG_SIZE);
 }
 
 __EXPORT void difftest_exec(uint64_t n) {
-  assert(0);
+  cpu_exec(n);
 }
 
+#ifdef CONFIG_BREAKPOINT
+// run without comparison until the next time `pc` is reached
+__EXPORT bool difftest_run_to_pc(vaddr_t pc) {
+  void bp_run_to(vaddr_t pc);
+  bp_run_to(pc);
+  return nemu_state.state == NEMU_STOP && cpu.pc == pc;
+}
+#endif
+
 __EXPORT void difftest_raise_intr(word_t NO) {
-  assert(0);
+  cpu.pc = isa_raise_intr(NO, cpu.pc);
+}
+
+#ifdef CONFIG_PMEM_DIRTY
+// fill `pages` with at most `max` pages written since the last call
+__EXPORT size_t difftest_dirty(paddr_t *pages, size_t max) {
+  size_t n = 0;
+  for (int i = 0; i < NR_PMEM_PAGE; i ++) {
+    if (paddr_is_dirty(i, DIRTY_DIFFTEST_MEMCHECK)) {
+      if (n == max) break;
+      pages[n ++] = PMEM_LEFT + i * PAGE_SIZE;
+      pmem_dirty[i] &= ~(1u << DIRTY_DIFFTEST_MEMCHECK);
+    }
+  }
+  return n;
+}
+
+__EXPORT void difftest_memhash(const paddr_t *pages, uint64_t *hash, size_t n) {
+  for (size_t i = 0; i < n; i ++) {
+    hash[i] = hash64(guest_to_host(pages[i]), PAGE_SIZE);
+  }
 }
+#endif
 
 __EXPORT void difftest_init(int port) {
   void init_mem();
@@ -0,0 +1,118 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/ftrace.h>
+#include <cpu/callstack.h>
+
+#ifdef CONFIG_FTRACE
+/* Calls and returns are recorded into a ring of binary events, which is
+ * only symbolized when it is dumped. Every instruction is counted for the
+ * function on the top of the shadow stack (see cpu/callstack.h), and the
+ * function is only looked up in the symbol table at a call or a return.
+ */
+#define RING_SIZE CONFIG_FTRACE_RING_SIZE
+
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "FTRACE_RING_SIZE must be a power of 2");
+
+enum { EV_CALL, EV_RET };
+
+typedef struct {
+  uint64_t nr_inst;
+  vaddr_t pc;
+  vaddr_t target;
+  uint16_t depth;
+  uint8_t type;
+} FtraceEvent;
+
+static FtraceEvent ring[RING_SIZE];
+static uint64_t nr_event = 0;
+
+static int cur_func = -1;
+
+// instruction counts indexed by symbol + 1, where 0 is for unknown code
+static uint64_t *func_inst = NULL;
+static int nr_func = 0;
+
+extern uint64_t g_nr_guest_inst;
+
+static inline void record(int type, vaddr_t pc, vaddr_t target, int depth) {
+  ring[nr_event ++ & (RING_SIZE - 1)] = (FtraceEvent) {
+    .nr_inst = g_nr_guest_inst, .pc = pc, .target = target, .depth = depth, .type = type };
+}
+
+// the call stack has been updated with this instruction
+void ftrace_step(Decode *s) {
+  CallStack *c = &g_callstack;
+  func_inst[cur_func + 1] ++;
+  switch (c->jump) {
+    case INST_JUMP_CALL:
+      // at the depth of the caller
+      record(EV_CALL, s->pc, s->dnpc, c->depth - 2);
+      cur_func = symbol_find(s->dnpc);
+      break;
+    case INST_JUMP_RET:
+      // at the depth of the callee
+      record(EV_RET, s->pc, s->dnpc, c->depth);
+      // the caller is unknown if its frame is dropped
+      cur_func = symbol_find(c->depth <= CALLSTACK_MAX_DEPTH ? c->entry[c->depth - 1] : s->dnpc);
+      break;
+  }
+}
+
+static const char* func_name(int idx) {
+  return (idx >= 0 ? symbol_name(idx) : "???");
+}
+
+static int count_cmp(const void *a, const void *b) {
+  uint64_t x = func_inst[*(const int *)a + 1], y = func_inst[*(const int *)b + 1];
+  return (x < y) - (x > y);
+}
+
+void ftrace_report() {
+  extern FILE *log_fp;
+  uint64_t start = (nr_event > RING_SIZE ? nr_event - RING_SIZE : 0);
+  fprintf(log_fp, "ftrace: the last %" PRIu64 " of %" PRIu64 " call/return events\n",
+      nr_event - start, nr_event);
+  for (uint64_t i = start; i < nr_event; i ++) {
+    FtraceEvent *e = &ring[i & (RING_SIZE - 1)];
+    int indent = (e->depth < 64 ? e->depth : 64) * 2;
+    fprintf(log_fp, "%12" PRIu64 " " FMT_WORD ": %*s%s [%s@" FMT_WORD "]\n", e->nr_inst, e->pc,
+        indent, "", (e->type == EV_CALL ? "call" : "ret "), func_name(symbol_find(e->target)), e->target);
+  }
+
+  int *order = malloc(sizeof(int) * (nr_func + 1));
+  int n = 0;
+  for (int i = -1; i < nr_func; i ++) {
+    if (func_inst[i + 1] > 0) order[n ++] = i;
+  }
+  qsort(order, n, sizeof(int), count_cmp);
+  fprintf(log_fp, "ftrace: instructions executed in each function\n");
+  for (int i = 0; i < n; i ++) {
+    fprintf(log_fp, "%16" PRIu64 "  %s\n", func_inst[order[i] + 1], func_name(order[i]));
+  }
+  free(order);
+  if (log_fp != stdout) Log("The result of ftrace is written to the log file");
+}
+
+void init_ftrace() {
+  nr_func = symbol_nr();
+  func_inst = calloc(nr_func + 1, sizeof(uint64_t));
+  assert(func_inst);
+  cur_func = symbol_find(cpu.pc);
+  if (nr_func == 0) Log("No symbols for ftrace, use --elf to read them");
+}
+#endif
@@ -0,0 +1,121 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/inst-stat.h>
+
+#ifdef CONFIG_INST_STAT
+/* The interpreter has no notion of blocks, so the counters are updated
+ * for every instruction. The counts of pcs are kept in an open-addressing
+ * table with the keys and the counts in separate arrays.
+ */
+#define NR_PC_SLOT (1 << 16)
+
+enum { BRANCH_TAKEN = NR_INST_CLASS, NR_COUNTER };
+
+static const char *counter_name[NR_COUNTER] = {
+  [INST_CLASS_ALU] = "alu", [INST_CLASS_MULDIV] = "muldiv",
+  [INST_CLASS_LOAD] = "load", [INST_CLASS_STORE] = "store",
+  [INST_CLASS_BRANCH] = "branch_not_taken", [BRANCH_TAKEN] = "branch_taken",
+  [INST_CLASS_JUMP] = "jump", [INST_CLASS_CSR] = "csr",
+  [INST_CLASS_SYSTEM] = "system", [INST_CLASS_OTHER] = "other",
+};
+
+// the order in the output
+static const int counter_order[NR_COUNTER] = {
+  INST_CLASS_ALU, INST_CLASS_MULDIV, INST_CLASS_LOAD, INST_CLASS_STORE, BRANCH_TAKEN,
+  INST_CLASS_BRANCH, INST_CLASS_JUMP, INST_CLASS_CSR, INST_CLASS_SYSTEM, INST_CLASS_OTHER,
+};
+
+static uint64_t counter[NR_COUNTER] = {};
+static const char *json_file = NULL;
+
+#ifdef CONFIG_INST_STAT_HOTPC
+static vaddr_t pc_key[NR_PC_SLOT];
+static uint64_t pc_count[NR_PC_SLOT];
+static uint64_t pc_dropped = 0;
+
+static inline void count_pc(vaddr_t pc) {
+  uint32_t i = (uint32_t)(((uint64_t)pc * 0x9e3779b97f4a7c15ull) >> 48);
+  for (int k = 0; k < NR_PC_SLOT; k ++, i = (i + 1) & (NR_PC_SLOT - 1)) {
+    if (pc_key[i] == pc && pc_count[i] != 0) { pc_count[i] ++; return; }
+    if (pc_count[i] == 0) { pc_key[i] = pc; pc_count[i] = 1; return; }
+  }
+  pc_dropped ++;
+}
+
+static int hotpc_cmp(const void *a, const void *b) {
+  uint64_t x = pc_count[*(const int *)a], y = pc_count[*(const int *)b];
+  return (x < y) - (x > y);
+}
+#endif
+
+void inst_stat_step(Decode *s) {
+  int c = isa_inst_class(s);
+  if (c == INST_CLASS_BRANCH && s->dnpc != s->snpc) c = BRANCH_TAKEN;
+  counter[c] ++;
+  IFDEF(CONFIG_INST_STAT_HOTPC, count_pc(s->pc));
+}
+
+static void write_json(FILE *fp) {
+  extern uint64_t g_nr_guest_inst;
+  fprintf(fp, "{\n  \"instructions\": %" PRIu64 ",\n  \"class\": {", g_nr_guest_inst);
+  for (int i = 0; i < NR_COUNTER; i ++) {
+    int c = counter_order[i];
+    fprintf(fp, "%s\n    \"%s\": %" PRIu64, (i == 0 ? "" : ","), counter_name[c], counter[c]);
+  }
+  fprintf(fp, "\n  }");
+#ifdef CONFIG_INST_STAT_HOTPC
+  int *order = malloc(sizeof(int) * NR_PC_SLOT);
+  int n = 0;
+  for (int i = 0; i < NR_PC_SLOT; i ++) {
+    if (pc_count[i] != 0) order[n ++] = i;
+  }
+  qsort(order, n, sizeof(int), hotpc_cmp);
+  fprintf(fp, ",\n  \"distinct_pcs\": %d,\n  \"dropped_pcs\": %" PRIu64 ",\n  \"hot_pcs\": [", n, pc_dropped);
+  for (int i = 0; i < n && i < CONFIG_INST_STAT_TOP; i ++) {
+    int idx = symbol_find(pc_key[order[i]]);
+    fprintf(fp, "%s\n    { \"pc\": \"" FMT_WORD "\", \"count\": %" PRIu64 ", \"symbol\": \"%s\" }",
+        (i == 0 ? "" : ","), pc_key[order[i]], pc_count[order[i]], (idx >= 0 ? symbol_name(idx) : ""));
+  }
+  fprintf(fp, "\n  ]");
+  free(order);
+#endif
+  fprintf(fp, "\n}\n");
+}
+
+void inst_stat_report() {
+  if (json_file == NULL) {
+    for (int i = 0; i < NR_COUNTER; i ++) {
+      int c = counter_order[i];
+      if (counter[c] != 0) Log("%-16s = %" PRIu64, counter_name[c], counter[c]);
+    }
+    return;
+  }
+  FILE *fp = fopen(json_file, "w");
+  if (fp == NULL) {
+    Log("Can not open '%s' for the statistics", json_file);
+    return;
+  }
+  write_json(fp);
+  fclose(fp);
+  Log("Statistics of instructions are written to %s", json_file);
+}
+
+void init_inst_stat(const char *file) {
+  json_file = file;
+}
+#endif
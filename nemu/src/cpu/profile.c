@@ -0,0 +1,167 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/profile.h>
+#include <cpu/callstack.h>
+
+#ifdef CONFIG_PROFILE
+/* Every CONFIG_PROFILE_INTERVAL instructions, the current pc and the
+ * shadow call stack are sampled. A frame is recorded as the entry of its
+ * function, or as the pc itself if no symbol covers it. The samples are
+ * aggregated by their stacks, which are symbolized in the report.
+ */
+#define NR_STACK_SLOT 65536
+
+typedef struct {
+  uint64_t hash;
+  uint64_t count;
+  uint32_t off;  // in `frames`
+  uint32_t depth;
+} Stack;
+
+static Stack stacks[NR_STACK_SLOT] = {};
+static int nr_stack = 0;
+static vaddr_t *frames = NULL;
+static uint32_t nr_frame = 0, max_frame = 0;
+static uint64_t nr_sample = 0, nr_dropped = 0;
+static int countdown = CONFIG_PROFILE_INTERVAL;
+static const char *folded_file = NULL;
+
+static inline vaddr_t frame_of(vaddr_t pc) {
+  int i = symbol_find(pc);
+  return (i >= 0 ? symbol_addr(i) : pc);
+}
+
+static void sample(vaddr_t pc) {
+  vaddr_t f[CALLSTACK_MAX_DEPTH + 1];
+  int n = 0;
+#ifdef CONFIG_PROFILE_CALLSTACK
+  // the innermost frame is replaced by the function of `pc` below
+  CallStack *c = &g_callstack;
+  for (int i = 0; i < c->depth - 1 && i < CALLSTACK_MAX_DEPTH; i ++) f[n ++] = frame_of(c->entry[i]);
+#endif
+  f[n ++] = frame_of(pc);
+  nr_sample ++;
+
+  uint64_t h = hash64(f, sizeof(f[0]) * n);
+  for (uint32_t i = h % NR_STACK_SLOT, k = 0; k < NR_STACK_SLOT; i = (i + 1) % NR_STACK_SLOT, k ++) {
+    Stack *s = &stacks[i];
+    if (s->count == 0) {
+      if (nr_frame + n > max_frame) {
+        max_frame = (max_frame == 0 ? 4096 : max_frame * 2);
+        frames = realloc(frames, sizeof(vaddr_t) * max_frame);
+        assert(frames);
+      }
+      *s = (Stack) { .hash = h, .count = 1, .off = nr_frame, .depth = n };
+      memcpy(frames + nr_frame, f, sizeof(f[0]) * n);
+      nr_frame += n;
+      nr_stack ++;
+      return;
+    }
+    if (s->hash == h && s->depth == n && memcmp(frames + s->off, f, sizeof(f[0]) * n) == 0) {
+      s->count ++;
+      return;
+    }
+  }
+  nr_dropped ++;
+}
+
+void profile_step(Decode *s) {
+  if (-- countdown == 0) {
+    countdown = CONFIG_PROFILE_INTERVAL;
+    sample(s->dnpc);
+  }
+}
+
+static void frame_name(vaddr_t f, char *buf, size_t size) {
+  int i = symbol_find(f);
+  if (i >= 0) snprintf(buf, size, "%s", symbol_name(i));
+  else snprintf(buf, size, FMT_WORD, f);
+}
+
+static void write_folded() {
+  FILE *fp = fopen(folded_file, "w");
+  if (fp == NULL) {
+    Log("Can not open '%s' for the folded stacks", folded_file);
+    return;
+  }
+  char name[128];
+  for (int i = 0; i < NR_STACK_SLOT; i ++) {
+    Stack *s = &stacks[i];
+    if (s->count == 0) continue;
+    for (int j = 0; j < s->depth; j ++) {
+      frame_name(frames[s->off + j], name, sizeof(name));
+      fprintf(fp, "%s%s", (j == 0 ? "" : ";"), name);
+    }
+    fprintf(fp, " %" PRIu64 "\n", s->count);
+  }
+  fclose(fp);
+  Log("Folded stacks are written to %s", folded_file);
+}
+
+typedef struct {
+  vaddr_t frame;
+  uint64_t count;
+} FlatEntry;
+
+static int flat_cmp_frame(const void *a, const void *b) {
+  vaddr_t x = ((const FlatEntry *)a)->frame, y = ((const FlatEntry *)b)->frame;
+  return (x > y) - (x < y);
+}
+
+static int flat_cmp_count(const void *a, const void *b) {
+  uint64_t x = ((const FlatEntry *)a)->count, y = ((const FlatEntry *)b)->count;
+  return (x < y) - (x > y);
+}
+
+// the samples of a function, without the ones of its callees
+static void report_flat() {
+  FlatEntry *flat = malloc(sizeof(FlatEntry) * (nr_stack + 1));
+  int n = 0;
+  for (int i = 0; i < NR_STACK_SLOT; i ++) {
+    Stack *s = &stacks[i];
+    if (s->count == 0) continue;
+    flat[n ++] = (FlatEntry) { .frame = frames[s->off + s->depth - 1], .count = s->count };
+  }
+  qsort(flat, n, sizeof(FlatEntry), flat_cmp_frame);
+  int m = 0;
+  for (int i = 0; i < n; i ++) {
+    if (m > 0 && flat[m - 1].frame == flat[i].frame) flat[m - 1].count += flat[i].count;
+    else flat[m ++] = flat[i];
+  }
+  qsort(flat, m, sizeof(FlatEntry), flat_cmp_count);
+
+  Log("top %d of %" PRIu64 " samples, one per %d instructions:", CONFIG_PROFILE_TOP, nr_sample, CONFIG_PROFILE_INTERVAL);
+  char name[128];
+  for (int i = 0; i < m && i < CONFIG_PROFILE_TOP; i ++) {
+    frame_name(flat[i].frame, name, sizeof(name));
+    Log("%6.2f%% %10" PRIu64 "  %s", flat[i].count * 100.0 / nr_sample, flat[i].count, name);
+  }
+  free(flat);
+}
+
+void profile_report() {
+  if (nr_sample == 0) return;
+  report_flat();
+  if (nr_dropped > 0) Log("%" PRIu64 " samples are dropped since there are too many stacks", nr_dropped);
+  if (folded_file != NULL) write_folded();
+}
+
+void init_profile(const char *file) {
+  folded_file = file;
+}
+#endif
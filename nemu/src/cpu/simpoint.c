@@ -0,0 +1,218 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/simpoint.h>
+#include <memory/paddr.h>
+#include <checkpoint-def.h>
+
+#ifdef CONFIG_SIMPOINT
+/* A basic block ends at a branch, a jump or any instruction which does
+ * not fall through. The blocks are numbered from 1 in the order they are
+ * first seen. At the end of each interval, the instructions executed in
+ * each block are written as a line of the `.bb' format of SimPoint:
+ *   T:id:count :id:count ...
+ * Intervals end at block boundaries, so they can be a few instructions
+ * longer than CONFIG_SIMPOINT_INTERVAL.
+ */
+#define NR_BB_SLOT (1 << 18)
+#define MAX_SIMPOINT 1024
+#define MAX_ISA_STATE 4096
+
+extern uint64_t g_nr_guest_inst;
+
+static bool enable = false;
+static FILE *bbv_fp = NULL;
+
+static vaddr_t bb_key[NR_BB_SLOT];
+static uint32_t bb_id[NR_BB_SLOT];    // 0 if the slot is free
+static uint64_t bb_count[NR_BB_SLOT]; // instructions in the current interval
+static uint32_t touched[NR_BB_SLOT];  // slots with a non-zero count
+static int nr_touched = 0;
+static uint32_t nr_bb = 0;
+
+// the current block and interval
+static vaddr_t bb_start = 0;
+static uint64_t bb_len = 0;
+static uint64_t interval = 0, interval_inst = 0;
+
+// the intervals to take checkpoints at, in ascending order
+static const char *cpt_dir = NULL;
+static uint64_t simpoints[MAX_SIMPOINT];
+static int nr_simpoint = 0, next_simpoint = 0;
+
+static uint32_t bb_slot(vaddr_t pc) {
+  uint32_t i = (uint32_t)(((uint64_t)pc * 0x9e3779b97f4a7c15ull) >> 46);
+  while (bb_id[i] != 0) {
+    if (bb_key[i] == pc) return i;
+    i = (i + 1) & (NR_BB_SLOT - 1);
+  }
+  Assert(nr_bb < NR_BB_SLOT / 2, "too many basic blocks");
+  bb_key[i] = pc;
+  bb_id[i] = ++ nr_bb;
+  return i;
+}
+
+static void bbv_dump() {
+  if (bbv_fp) fputc('T', bbv_fp);
+  for (int k = 0; k < nr_touched; k ++) {
+    uint32_t i = touched[k];
+    if (bbv_fp) fprintf(bbv_fp, ":%u:%" PRIu64 " ", bb_id[i], bb_count[i]);
+    bb_count[i] = 0;
+  }
+  if (bbv_fp) fputc('\n', bbv_fp);
+  nr_touched = 0;
+}
+
+static void bbv_close() {
+  // the last interval, which may be shorter
+  if (nr_touched > 0) bbv_dump();
+  fclose(bbv_fp);
+}
+
+static void checkpoint_save() {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%" PRIu64 ".cpt", cpt_dir, interval);
+  FILE *fp = fopen(path, "wb");
+  Assert(fp, "Can not open '%s'", path);
+
+  // skip the pages never written since init_mem()
+  static uint8_t fill[CPT_PAGE_SIZE];
+  memset(fill, pmem_init_byte, CPT_PAGE_SIZE);
+  static uint8_t isa_state[MAX_ISA_STATE];
+  size_t isa_size = isa_cpt_save(isa_state, sizeof(isa_state));
+  CptHeader h = { .magic = CPT_MAGIC, .version = CPT_VERSION, .word_size = sizeof(word_t),
+    .isa = str(__GUEST_ISA__), .cpu_size = sizeof(cpu), .isa_size = isa_size,
+    .fill = pmem_init_byte, .pc = cpu.pc, .nr_inst = g_nr_guest_inst, .interval = interval };
+  for (uint64_t off = 0; off < CONFIG_MSIZE; off += CPT_PAGE_SIZE) {
+    if (memcmp(guest_to_host(PMEM_LEFT + off), fill, CPT_PAGE_SIZE) != 0) h.nr_page ++;
+  }
+  fwrite(&h, sizeof(h), 1, fp);
+  fwrite(&cpu, sizeof(cpu), 1, fp);
+  fwrite(isa_state, isa_size, 1, fp);
+  for (uint64_t off = 0; off < CONFIG_MSIZE; off += CPT_PAGE_SIZE) {
+    uint8_t *page = guest_to_host(PMEM_LEFT + off);
+    if (memcmp(page, fill, CPT_PAGE_SIZE) != 0) {
+      uint64_t addr = PMEM_LEFT + off;
+      fwrite(&addr, sizeof(addr), 1, fp);
+      fwrite(page, CPT_PAGE_SIZE, 1, fp);
+    }
+  }
+  fclose(fp);
+  Log("Checkpoint of interval %" PRIu64 " at pc = " FMT_WORD " (%" PRIu64 " pages) is saved to %s",
+      interval, cpu.pc, h.nr_page, path);
+}
+
+static void check_simpoint() {
+  while (next_simpoint < nr_simpoint && simpoints[next_simpoint] < interval) next_simpoint ++;
+  if (next_simpoint < nr_simpoint && simpoints[next_simpoint] == interval) {
+    checkpoint_save();
+    next_simpoint ++;
+  }
+}
+
+void simpoint_step(Decode *s) {
+  if (!enable) return;
+  if (bb_len == 0) bb_start = s->pc;
+  bb_len ++;
+  interval_inst ++;
+  int cls = isa_inst_class(s);
+  if (s->dnpc == s->snpc && cls != INST_CLASS_BRANCH && cls != INST_CLASS_JUMP) return;
+
+  uint32_t i = bb_slot(bb_start);
+  if (bb_count[i] == 0) touched[nr_touched ++] = i;
+  bb_count[i] += bb_len;
+  bb_len = 0;
+
+  if (interval_inst >= CONFIG_SIMPOINT_INTERVAL) {
+    bbv_dump();
+    interval ++;
+    interval_inst = 0;
+    check_simpoint();
+  }
+}
+
+static int u64_cmp(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// each line of the `.simpoints' file of SimPoint is "interval cluster"
+static void load_simpoints(const char *file) {
+  FILE *fp = fopen(file, "r");
+  Assert(fp, "Can not open '%s'", file);
+  uint64_t idx;
+  int cluster;
+  while (fscanf(fp, "%" SCNu64 " %d", &idx, &cluster) == 2) {
+    Assert(nr_simpoint < MAX_SIMPOINT, "too many simpoints in '%s'", file);
+    simpoints[nr_simpoint ++] = idx;
+  }
+  fclose(fp);
+  qsort(simpoints, nr_simpoint, sizeof(simpoints[0]), u64_cmp);
+  Log("%d simpoints are read from %s", nr_simpoint, file);
+}
+
+long simpoint_restore(const char *cpt_file) {
+  FILE *fp = fopen(cpt_file, "rb");
+  Assert(fp, "Can not open '%s'", cpt_file);
+  CptHeader h;
+  int ret = fread(&h, sizeof(h), 1, fp);
+  Assert(ret == 1 && memcmp(h.magic, CPT_MAGIC, sizeof(CPT_MAGIC)) == 0 && h.version == CPT_VERSION,
+      "'%s' is not a checkpoint", cpt_file);
+  Assert(strcmp(h.isa, str(__GUEST_ISA__)) == 0 && h.cpu_size == sizeof(cpu),
+      "'%s' is a checkpoint of %s", cpt_file, h.isa);
+  ret = fread(&cpu, sizeof(cpu), 1, fp);
+  assert(ret == 1);
+  static uint8_t isa_state[MAX_ISA_STATE];
+  Assert(h.isa_size <= sizeof(isa_state), "bad size of the states of the ISA in '%s'", cpt_file);
+  ret = fread(isa_state, h.isa_size, 1, fp);
+  assert(h.isa_size == 0 || ret == 1);
+
+  memset(guest_to_host(PMEM_LEFT), h.fill, CONFIG_MSIZE);
+  for (uint64_t k = 0; k < h.nr_page; k ++) {
+    uint64_t addr;
+    ret = fread(&addr, sizeof(addr), 1, fp);
+    Assert(ret == 1 && addr - PMEM_LEFT <= CONFIG_MSIZE - CPT_PAGE_SIZE,
+        "bad page in '%s'", cpt_file);
+    ret = fread(guest_to_host(addr), CPT_PAGE_SIZE, 1, fp);
+    assert(ret == 1);
+  }
+  fclose(fp);
+
+  // the counters of the ISA are based on the number of instructions
+  g_nr_guest_inst = h.nr_inst;
+  isa_cpt_restore(isa_state, h.isa_size);
+  interval = h.interval;
+  Log("Checkpoint of interval %" PRIu64 " is restored from %s, pc = " FMT_WORD, interval, cpt_file, cpu.pc);
+  return PMEM_RIGHT - RESET_VECTOR + 1;
+}
+
+void init_simpoint(const char *bbv_file, const char *simpoints_file, const char *cpt_dir_) {
+  if (bbv_file != NULL) {
+    bbv_fp = fopen(bbv_file, "w");
+    Assert(bbv_fp, "Can not open '%s'", bbv_file);
+    atexit(bbv_close);
+    Log("Basic block vectors of every %d instructions are written to %s", CONFIG_SIMPOINT_INTERVAL, bbv_file);
+  }
+  if (simpoints_file != NULL) {
+    Assert(cpt_dir_ != NULL, "the directory of checkpoints is not given by --checkpoint");
+    cpt_dir = cpt_dir_;
+    load_simpoints(simpoints_file);
+  }
+  enable = (bbv_fp != NULL || nr_simpoint > 0);
+  if (nr_simpoint > 0) check_simpoint();
+}
+#endif
@@ -0,0 +1,101 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/timing.h>
+#include <cpu/bpsim.h>
+#include <memory/cachesim.h>
+
+#ifdef CONFIG_TIMING
+/* A single-issue in-order pipeline with blocking caches. An instruction
+ * issues one cycle after the previous one, or later when its source
+ * registers are not ready yet. Cache misses and branch mispredictions are
+ * taken from the cache and branch predictor models, when they are enabled,
+ * as the difference of their miss counters since the previous instruction.
+ */
+static const int latency[NR_INST_CLASS] = {
+  [INST_CLASS_ALU] = 1, [INST_CLASS_MULDIV] = CONFIG_TIMING_MULDIV_LATENCY,
+  [INST_CLASS_LOAD] = CONFIG_TIMING_LOAD_LATENCY, [INST_CLASS_STORE] = 1,
+  [INST_CLASS_BRANCH] = 1, [INST_CLASS_JUMP] = 1, [INST_CLASS_CSR] = 1,
+  [INST_CLASS_SYSTEM] = 1, [INST_CLASS_OTHER] = 1,
+};
+
+enum { STALL_DATA, STALL_ICACHE, STALL_DCACHE, STALL_BRANCH, NR_STALL };
+
+static uint64_t cycle = 0;      // issue cycle of the last instruction
+static uint64_t nr_inst = 0;
+static uint64_t reg_ready[32];  // the cycle when the value of a register is available
+static uint64_t stall[NR_STALL] = {};
+static uint64_t last_imiss = 0, last_dmiss = 0, last_bmiss = 0;
+
+static inline uint64_t nr_mispredict(Decode *s, int cls) {
+#ifdef CONFIG_BPSIM
+  uint64_t bmiss = bpsim_nr_miss();
+  uint64_t n = bmiss - last_bmiss;
+  last_bmiss = bmiss;
+  return n;
+#else
+  // predict not taken
+  return ((cls == INST_CLASS_BRANCH || cls == INST_CLASS_JUMP) && s->dnpc != s->snpc);
+#endif
+}
+
+void timing_step(Decode *s) {
+  int cls = isa_inst_class(s);
+  int rd, rs1, rs2;
+  isa_inst_regs(s, &rd, &rs1, &rs2);
+
+  uint64_t issue = cycle + 1;
+#ifdef CONFIG_CACHESIM
+  uint64_t imiss = cachesim_nr_miss(true), dmiss = cachesim_nr_miss(false);
+  uint64_t ipenalty = (imiss - last_imiss) * CONFIG_TIMING_ICACHE_MISS_PENALTY;
+  uint64_t dpenalty = (dmiss - last_dmiss) * CONFIG_TIMING_DCACHE_MISS_PENALTY;
+  last_imiss = imiss;
+  last_dmiss = dmiss;
+  issue += ipenalty;
+  stall[STALL_ICACHE] += ipenalty;
+#endif
+
+  uint64_t ready = issue;
+  if (rs1 >= 0 && reg_ready[rs1] > ready) ready = reg_ready[rs1];
+  if (rs2 >= 0 && reg_ready[rs2] > ready) ready = reg_ready[rs2];
+  stall[STALL_DATA] += ready - issue;
+  issue = ready;
+
+#ifdef CONFIG_CACHESIM
+  issue += dpenalty;
+  stall[STALL_DCACHE] += dpenalty;
+#endif
+  if (rd >= 0) reg_ready[rd] = issue + latency[cls];
+
+  // the next instruction is fetched after the branch is resolved
+  uint64_t bpenalty = nr_mispredict(s, cls) * CONFIG_TIMING_BRANCH_PENALTY;
+  stall[STALL_BRANCH] += bpenalty;
+  cycle = issue + bpenalty;
+  nr_inst ++;
+}
+
+uint64_t timing_cycles() {
+  return cycle;
+}
+
+void timing_report() {
+  Log("timing: %" PRIu64 " cycles, %" PRIu64 " instructions, IPC = %.3f, CPI = %.3f", cycle, nr_inst,
+      (cycle ? (double)nr_inst / cycle : 0), (nr_inst ? (double)cycle / nr_inst : 0));
+  Log("timing: stall cycles: data %" PRIu64 ", icache %" PRIu64 ", dcache %" PRIu64 ", branch %" PRIu64,
+      stall[STALL_DATA], stall[STALL_ICACHE], stall[STALL_DCACHE], stall[STALL_BRANCH]);
+}
+#endif
@@ -16,6 +16,7 @@
 #include <common.h>
 #include <device/map.h>
 #include <SDL2/SDL.h>
+#include <stdatomic.h>
 
 enum {
   reg_freq,
@@ -27,15 +28,114 @@ enum {
   nr_reg
 };
 
+static_assert((CONFIG_SB_SIZE & (CONFIG_SB_SIZE - 1)) == 0, "CONFIG_SB_SIZE should be a power of 2");
+
 static uint8_t *sbuf = NULL;
 static uint32_t *audio_base = NULL;
 
+/* The stream buffer is used as a single-producer/single-consumer ring.
+ * The guest (emulation thread) is the only producer: it fills `sbuf` at its
+ * own write cursor and then commits the bytes by writing their number to
+ * `reg_count`. The SDL audio callback (audio thread) is the only consumer.
+ * `sbuf_tail` is only advanced by the producer and `sbuf_head` only by the
+ * consumer, both free running, so no lock is needed on either side.
+ */
+static _Atomic uint32_t sbuf_head = 0;
+static _Atomic uint32_t sbuf_tail = 0;
+
+static uint32_t sbuf_count() {
+  uint32_t head = atomic_load_explicit(&sbuf_head, memory_order_acquire);
+  uint32_t tail = atomic_load_explicit(&sbuf_tail, memory_order_relaxed);
+  return tail - head;
+}
+
+static void sbuf_reset() {
+  atomic_store(&sbuf_head, 0);
+  atomic_store(&sbuf_tail, 0);
+}
+
+static void audio_play(void *userdata, uint8_t *stream, int len) {
+  uint32_t head = atomic_load_explicit(&sbuf_head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&sbuf_tail, memory_order_acquire);
+  uint32_t nread = tail - head;
+  if (nread > len) nread = len;
+
+  uint32_t pos = head % CONFIG_SB_SIZE;
+  uint32_t first = CONFIG_SB_SIZE - pos;
+  if (first > nread) first = nread;
+  memcpy(stream, sbuf + pos, first);
+  memcpy(stream + first, sbuf, nread - first);
+  // play silence if the guest can not catch up
+  memset(stream + nread, 0, len - nread);
+
+  atomic_store_explicit(&sbuf_head, head + nread, memory_order_release);
+}
+
+static void audio_init() {
+  static bool opened = false;
+  static SDL_AudioSpec cur = {};
+  SDL_AudioSpec s = {};
+  s.format = AUDIO_S16SYS;
+  s.userdata = NULL;
+  s.freq = audio_base[reg_freq];
+  s.channels = audio_base[reg_channels];
+  s.samples = audio_base[reg_samples];
+  s.callback = audio_play;
+
+  // the guest restarts writing at the beginning of the stream buffer
+  if (opened) {
+    if (s.freq == cur.freq && s.channels == cur.channels && s.samples == cur.samples) {
+      // keep the device open, and the callback is not running while it is locked
+      SDL_LockAudio();
+      sbuf_reset();
+      SDL_UnlockAudio();
+      return;
+    }
+    // the callback is not running after the device is closed
+    SDL_CloseAudio();
+    opened = false;
+  }
+  sbuf_reset();
+
+  int ret = SDL_InitSubSystem(SDL_INIT_AUDIO);
+  if (ret == 0) ret = SDL_OpenAudio(&s, NULL);
+  if (ret == 0) {
+    opened = true;
+    cur = s;
+    SDL_PauseAudio(0);
+  }
+  else Log("Can not initialize audio, freq = %d, channels = %d, samples = %d",
+      s.freq, s.channels, s.samples);
+}
+
+static void audio_commit(uint32_t n) {
+  uint32_t tail = atomic_load_explicit(&sbuf_tail, memory_order_relaxed);
+  uint32_t free = CONFIG_SB_SIZE - sbuf_count();
+  if (n > free) n = free; // the guest should never overflow the buffer
+  // make the data written by the guest visible before publishing it
+  atomic_store_explicit(&sbuf_tail, tail + n, memory_order_release);
+}
+
 static void audio_io_handler(uint32_t offset, int len, bool is_write) {
+  switch (offset / sizeof(uint32_t)) {
+    case reg_init:
+      if (is_write && audio_base[reg_init]) { audio_init(); audio_base[reg_init] = 0; }
+      break;
+    case reg_count:
+      if (is_write) audio_commit(audio_base[reg_count]);
+      audio_base[reg_count] = sbuf_count();
+      break;
+    case reg_sbuf_size:
+      audio_base[reg_sbuf_size] = CONFIG_SB_SIZE;
+      break;
+    default: break;
+  }
 }
 
 void init_audio() {
   uint32_t space_size = sizeof(uint32_t) * nr_reg;
   audio_base = (uint32_t *)new_space(space_size);
+  audio_base[reg_sbuf_size] = CONFIG_SB_SIZE;
 #ifdef CONFIG_HAS_PORT_IO
   add_pio_map ("audio", CONFIG_AUDIO_CTL_PORT, audio_base, space_size, audio_io_handler);
 #else
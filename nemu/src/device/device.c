@@ -18,6 +18,9 @@
 #include <device/alarm.h>
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #endif
 
 void init_map();
@@ -31,9 +34,79 @@ void init_sdcard();
 void init_alarm();
 
 void send_key(uint8_t, bool);
+void key_queue_clear();
 void vga_update_screen();
 
+#ifndef CONFIG_TARGET_AM
+/* SDL events must be handled on the thread which creates the window, so
+ * the main thread is kept for SDL, and the engine runs on a worker thread.
+ * Keys are passed to the keyboard through its lock-free queue, and the
+ * CPU thread never enters SDL.
+ */
+static _Atomic bool quit_requested = false;
+static _Atomic bool engine_done = false;
+static void (*engine_fn)() = NULL;
+
+static void handle_event(SDL_Event *event) {
+  switch (event->type) {
+    case SDL_QUIT:
+      atomic_store_explicit(&quit_requested, true, memory_order_release);
+      break;
+#ifdef CONFIG_HAS_KEYBOARD
+    // If a key was pressed
+    case SDL_KEYDOWN:
+    case SDL_KEYUP: {
+      uint8_t k = event->key.keysym.scancode;
+      bool is_keydown = (event->key.type == SDL_KEYDOWN);
+      send_key(k, is_keydown);
+      break;
+    }
+#endif
+    default: break;
+  }
+}
+
+static void* engine_thread(void *arg) {
+  engine_fn();
+  atomic_store_explicit(&engine_done, true, memory_order_release);
+  return NULL;
+}
+
+static void init_input() {
+  int ret = SDL_InitSubSystem(SDL_INIT_EVENTS);
+  Assert(ret == 0, "Can not initialize SDL events");
+}
+#endif
+
+void device_run(void (*engine)()) {
+#ifdef CONFIG_TARGET_AM
+  engine();
+#else
+  engine_fn = engine;
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, engine_thread, NULL);
+  Assert(ret == 0, "Can not create the engine thread");
+
+  // the timer interrupt is raised on the CPU thread
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGVTALRM);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  while (!atomic_load_explicit(&engine_done, memory_order_acquire)) {
+    SDL_Event event;
+    // wake up in time to refresh the screen
+    if (SDL_WaitEventTimeout(&event, 1000 / TIMER_HZ)) {
+      do handle_event(&event); while (SDL_PollEvent(&event));
+    }
+    IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+  }
+  pthread_join(thread, NULL);
+#endif
+}
+
 void device_update() {
+  SELF_PROF_SCOPE(SP_DEVICE);
   static uint64_t last = 0;
   uint64_t now = get_time();
   if (now - last < 1000000 / TIMER_HZ) {
@@ -41,36 +114,18 @@ void device_update() {
   }
   last = now;
 
+#ifdef CONFIG_TARGET_AM
   IFDEF(CONFIG_HAS_VGA, vga_update_screen());
-
-#ifndef CONFIG_TARGET_AM
-  SDL_Event event;
-  while (SDL_PollEvent(&event)) {
-    switch (event.type) {
-      case SDL_QUIT:
-        nemu_state.state = NEMU_QUIT;
-        break;
-#ifdef CONFIG_HAS_KEYBOARD
-      // If a key was pressed
-      case SDL_KEYDOWN:
-      case SDL_KEYUP: {
-        uint8_t k = event.key.keysym.scancode;
-        bool is_keydown = (event.key.type == SDL_KEYDOWN);
-        send_key(k, is_keydown);
-        break;
-      }
-#endif
-      default: break;
-    }
+#else
+  if (atomic_load_explicit(&quit_requested, memory_order_acquire)) {
+    nemu_state.state = NEMU_QUIT;
   }
 #endif
 }
 
-void sdl_clear_event_queue() {
-#ifndef CONFIG_TARGET_AM
-  SDL_Event event;
-  while (SDL_PollEvent(&event));
-#endif
+void device_clear_input() {
+  // drop the keys pressed while the guest is not running
+  IFDEF(CONFIG_HAS_KEYBOARD, IFNDEF(CONFIG_TARGET_AM, key_queue_clear()));
 }
 
 void init_device() {
@@ -86,4 +141,5 @@ void init_device() {
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
+  IFNDEF(CONFIG_TARGET_AM, init_input());
 }
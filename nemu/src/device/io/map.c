@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
@@ -46,6 +47,16 @@ static void invoke_callback(io_callback_t c, paddr_t offset, int len, bool is_wr
   if (c != NULL) { c(offset, len, is_write); }
 }
 
+/* REF can not model the devices, so an instruction accessing a device
+ * is skipped by REF, and REF is resynchronized with the registers of DUT
+ * after it, which include the value loaded. Accesses outside of
+ * instructions (such as `x` in sdb or watchpoints) should not cause
+ * any skipping.
+ */
+static inline void skip_ref() {
+  if (g_inst_exec) difftest_skip_ref();
+}
+
 void init_map() {
   io_space = malloc(IO_SPACE_MAX);
   assert(io_space);
@@ -53,18 +64,22 @@ void init_map() {
 }
 
 word_t map_read(paddr_t addr, int len, IOMap *map) {
+  SELF_PROF_SCOPE(SP_MMIO);
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
+  skip_ref();
   invoke_callback(map->callback, offset, len, false); // prepare data to read
   word_t ret = host_read(map->space + offset, len);
   return ret;
 }
 
 void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
+  SELF_PROF_SCOPE(SP_MMIO);
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
+  skip_ref();
   host_write(map->space + offset, len, data);
   invoke_callback(map->callback, offset, len, true);
 }
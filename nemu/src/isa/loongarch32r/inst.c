@@ -70,3 +70,15 @@ int isa_exec_once(Decode *s) {
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+
+int isa_jump_type(Decode *s) {
+  return INST_JUMP_NONE;
+}
+
+int isa_inst_class(Decode *s) {
+  return INST_CLASS_OTHER;
+}
+
+void isa_inst_regs(Decode *s, int *rd, int *rs1, int *rs2) {
+  *rd = *rs1 = *rs2 = -1;
+}
@@ -15,11 +15,22 @@
 
 #include <isa.h>
 #include <cpu/difftest.h>
+#include <cpu/decode.h>
 #include "../local-include/reg.h"
 
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc) {
-  return false;
+  bool ok = true;
+  for (int i = 0; i < MUXDEF(CONFIG_RVE, 16, 32); i ++) {
+    ok &= difftest_check_reg(reg_name(i), pc, ref_r->gpr[i], gpr(i));
+  }
+  ok &= difftest_check_reg("pc", pc, ref_r->pc, cpu.pc);
+  return ok;
 }
 
 void isa_difftest_attach() {
 }
+
+int isa_difftest_commit_reg(struct Decode *s) {
+  int rd = inst_rd(s->isa.inst.val);
+  return (rd < MUXDEF(CONFIG_RVE, 16, 32) ? rd : -1);
+}
@@ -17,13 +17,15 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/bpsim.h>
+#include "local-include/csr.h"
 
 #define R(i) gpr(i)
 #define Mr vaddr_read
 #define Mw vaddr_write
 
 enum {
-  TYPE_I, TYPE_U, TYPE_S,
+  TYPE_I, TYPE_U, TYPE_S, TYPE_J, TYPE_B,
   TYPE_N, // none
 };
 
@@ -32,6 +34,29 @@ enum {
 #define immI() do { *imm = SEXT(BITS(i, 31, 20), 12); } while(0)
 #define immU() do { *imm = SEXT(BITS(i, 31, 12), 20) << 12; } while(0)
 #define immS() do { *imm = (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7); } while(0)
+#define immJ() do { *imm = SEXT((BITS(i, 31, 31) << 20) | (BITS(i, 19, 12) << 12) | \
+                               (BITS(i, 20, 20) << 11) | (BITS(i, 30, 21) << 1), 21); } while(0)
+#define immB() do { *imm = SEXT((BITS(i, 31, 31) << 12) | (BITS(i, 7, 7) << 11) | \
+                               (BITS(i, 30, 25) << 5) | (BITS(i, 11, 8) << 1), 13); } while(0)
+
+#define branch(cond) do { \
+  bool taken = (cond); \
+  if (taken) s->dnpc = s->pc + imm; \
+  IFDEF(CONFIG_BPSIM, bpsim_branch(s->pc, taken, s->pc + imm)); \
+} while (0)
+
+enum { CSR_OP_W, CSR_OP_S, CSR_OP_C };
+
+// Zicsr: csrrw does not read the CSR if rd is x0, and csrrs and csrrc do
+// not write it if rs1 (or uimm) is 0
+static void csr_op(Decode *s, int rd, word_t val, int op) {
+  uint32_t i = s->isa.inst.val;
+  uint32_t addr = BITS(i, 31, 20);
+  bool wen = (op == CSR_OP_W || BITS(i, 19, 15) != 0);
+  word_t old = (op != CSR_OP_W || rd != 0 ? csr_read(addr) : 0);
+  if (wen) csr_write(addr, op == CSR_OP_W ? val : op == CSR_OP_S ? (old | val) : (old & ~val));
+  R(rd) = old;
+}
 
 static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_t *imm, int type) {
   uint32_t i = s->isa.inst.val;
@@ -42,6 +67,8 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
     case TYPE_I: src1R();          immI(); break;
     case TYPE_U:                   immU(); break;
     case TYPE_S: src1R(); src2R(); immS(); break;
+    case TYPE_J:                   immJ(); break;
+    case TYPE_B: src1R(); src2R(); immB(); break;
   }
 }
 
@@ -58,8 +85,24 @@ static int decode_exec(Decode *s) {
 
   INSTPAT_START();
   INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc  , U, R(rd) = s->pc + imm);
+  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, R(rd) = s->snpc; s->dnpc = s->pc + imm;
+      IFDEF(CONFIG_BPSIM, bpsim_jump(s)));
+  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, R(rd) = s->snpc; s->dnpc = (src1 + imm) & ~(word_t)1;
+      IFDEF(CONFIG_BPSIM, bpsim_jump(s)));
+  INSTPAT("??????? ????? ????? 000 ????? 11000 11", beq    , B, branch(src1 == src2));
+  INSTPAT("??????? ????? ????? 001 ????? 11000 11", bne    , B, branch(src1 != src2));
+  INSTPAT("??????? ????? ????? 100 ????? 11000 11", blt    , B, branch((sword_t)src1 < (sword_t)src2));
+  INSTPAT("??????? ????? ????? 101 ????? 11000 11", bge    , B, branch((sword_t)src1 >= (sword_t)src2));
+  INSTPAT("??????? ????? ????? 110 ????? 11000 11", bltu   , B, branch(src1 < src2));
+  INSTPAT("??????? ????? ????? 111 ????? 11000 11", bgeu   , B, branch(src1 >= src2));
   INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = Mr(src1 + imm, 1));
   INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
+  INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, csr_op(s, rd, src1, CSR_OP_W));
+  INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, csr_op(s, rd, src1, CSR_OP_S));
+  INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc  , I, csr_op(s, rd, src1, CSR_OP_C));
+  INSTPAT("??????? ????? ????? 101 ????? 11100 11", csrrwi , I, csr_op(s, rd, BITS(s->isa.inst.val, 19, 15), CSR_OP_W));
+  INSTPAT("??????? ????? ????? 110 ????? 11100 11", csrrsi , I, csr_op(s, rd, BITS(s->isa.inst.val, 19, 15), CSR_OP_S));
+  INSTPAT("??????? ????? ????? 111 ????? 11100 11", csrrci , I, csr_op(s, rd, BITS(s->isa.inst.val, 19, 15), CSR_OP_C));
 
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
@@ -74,3 +117,50 @@ int isa_exec_once(Decode *s) {
   s->isa.inst.val = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+
+// follow the hints of the return-address stack in the spec,
+// where x1 and x5 are the link registers
+#define is_link(r) ((r) == 1 || (r) == 5)
+
+int isa_jump_type(Decode *s) {
+  uint32_t i = s->isa.inst.val;
+  int rd = BITS(i, 11, 7);
+  int rs1 = BITS(i, 19, 15);
+  switch (BITS(i, 6, 0)) {
+    case 0x6f: // jal
+      return (is_link(rd) ? INST_JUMP_CALL : INST_JUMP_NONE);
+    case 0x67: // jalr
+      if (is_link(rd)) return INST_JUMP_CALL;
+      return (rd == 0 && is_link(rs1) ? INST_JUMP_RET : INST_JUMP_NONE);
+  }
+  return INST_JUMP_NONE;
+}
+
+int isa_inst_class(Decode *s) {
+  uint32_t i = s->isa.inst.val;
+  switch (BITS(i, 6, 0)) {
+    case 0x37: case 0x17: case 0x13: case 0x1b: return INST_CLASS_ALU;
+    case 0x33: case 0x3b: return (BITS(i, 31, 25) == 1 ? INST_CLASS_MULDIV : INST_CLASS_ALU);
+    case 0x03: case 0x07: return INST_CLASS_LOAD;
+    case 0x23: case 0x27: return INST_CLASS_STORE;
+    case 0x63: return INST_CLASS_BRANCH;
+    case 0x6f: case 0x67: return INST_CLASS_JUMP;
+    case 0x73: return (BITS(i, 14, 12) != 0 ? INST_CLASS_CSR : INST_CLASS_SYSTEM);
+    case 0x0f: return INST_CLASS_SYSTEM; // fence
+  }
+  return INST_CLASS_OTHER;
+}
+
+void isa_inst_regs(Decode *s, int *rd, int *rs1, int *rs2) {
+  uint32_t i = s->isa.inst.val;
+  bool has_rs1 = true, has_rs2 = false;
+  switch (BITS(i, 6, 0)) {
+    case 0x37: case 0x17: case 0x6f: has_rs1 = false; break;  // U, J
+    case 0x23: case 0x63: has_rs2 = true; break;              // S, B
+    case 0x33: case 0x3b: case 0x2f: has_rs2 = true; break;   // R, AMO
+    case 0x73: has_rs1 = (BITS(i, 14, 14) == 0); break;       // immediate CSR
+  }
+  *rd  = inst_rd(i);
+  *rs1 = (has_rs1 ? BITS(i, 19, 15) : -1);
+  *rs2 = (has_rs2 ? BITS(i, 24, 20) : -1);
+}
@@ -30,4 +30,13 @@ static inline const char* reg_name(int idx) {
   return regs[check_reg_idx(idx)];
 }
 
+// the register written by the instruction, or -1 if it writes none
+static inline int inst_rd(uint32_t inst) {
+  switch (BITS(inst, 6, 0)) {
+    case 0x23: case 0x63: return -1;  // S, B: bits 11-7 are immediate bits
+  }
+  int rd = BITS(inst, 11, 7);
+  return (rd != 0 ? rd : -1);
+}
+
 #endif
@@ -29,17 +29,25 @@ void isa_reg_display() {
   }
 }
 
-word_t isa_reg_str2val(const char *s, bool *success) {
+word_t* isa_reg_str2ptr(const char *s) {
   // gpr
-  for (int i = 0; i < ARRLEN(regs); ++i) {
+  for (int i = 0; i < MUXDEF(CONFIG_RVE, 16, 32); ++i) {
     if (strcmp(s, regs[i]) == 0) {
-      return gpr(i);
+      return &gpr(i);
     }
   }
   // pc
   if( strcmp(s, "pc") == 0){
-    return cpu.pc;
+    return &cpu.pc;
+  }
+  return NULL;
+}
+
+word_t isa_reg_str2val(const char *s, bool *success) {
+  word_t *reg = isa_reg_str2ptr(s);
+  if (reg == NULL) {
+    *success = false;
+    return -1;
   }
-  *success = false;
-  return -1;
+  return *reg;
 }
@@ -0,0 +1,144 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/difftest.h>
+#include <cpu/timing.h>
+#include <cpu/bpsim.h>
+#include <memory/cachesim.h>
+#include "../local-include/csr.h"
+
+/* The counters of Zicntr and Zihpm are not updated by instructions.
+ * Each of them is the difference between a counter kept by NEMU and an
+ * offset, which is only changed when the counter is written, so they cost
+ * nothing until they are accessed. Counter 1 is `time', which is the
+ * virtual clock in microseconds and read-only.
+ */
+#define NR_COUNTER 32
+
+static uint64_t offset[NR_COUNTER] = {};
+static word_t hpm_event[NR_COUNTER] = {};
+
+static uint64_t event_count(word_t event) {
+  switch (event) {
+    IFDEF(CONFIG_CACHESIM, case HPM_EVENT_ICACHE_MISS: return cachesim_nr_miss(true));
+    IFDEF(CONFIG_CACHESIM, case HPM_EVENT_DCACHE_MISS: return cachesim_nr_miss(false));
+    IFDEF(CONFIG_BPSIM, case HPM_EVENT_BRANCH_MISS: return bpsim_nr_miss());
+  }
+  return 0;
+}
+
+static uint64_t counter_source(int idx) {
+  extern uint64_t g_nr_guest_inst;
+  switch (idx) {
+    case 0: return timing_cycles();
+    case 1: return get_time();
+    case 2: return g_nr_guest_inst;
+    default: return event_count(hpm_event[idx]);
+  }
+}
+
+static inline uint64_t counter_get(int idx) {
+  return counter_source(idx) - offset[idx];
+}
+
+static inline void counter_set(int idx, uint64_t val) {
+  // instret, and cycle without the timing model, are counted after the
+  // instruction writing them retires, and the written value should be
+  // seen by the next instruction
+  bool by_inst = (idx == 2 || (idx == 0 && !ISDEF(CONFIG_TIMING)));
+  offset[idx] = counter_source(idx) + by_inst - val;
+}
+
+// mcycle and friends at 0xb00, cycle and friends at 0xc00, with the high
+// halves of RV32 at +0x80
+static inline bool is_counter(uint32_t addr) {
+  uint32_t base = addr & ~0x9fu;
+  if (base != CSR_MCYCLE && base != CSR_CYCLE) return false;
+  if (MUXDEF(CONFIG_RV64, addr & 0x80, false)) return false;
+  // there is no mtime CSR
+  return !(base == CSR_MCYCLE && (addr & 0x1f) == 1);
+}
+
+static void bad_csr(uint32_t addr, const char *op) {
+  panic("can not %s CSR 0x%03x at pc = " FMT_WORD, op, addr, cpu.pc);
+}
+
+word_t csr_read(uint32_t addr) {
+  if (is_counter(addr)) {
+    // the counters of REF are different
+    IFDEF(CONFIG_DIFFTEST, difftest_skip_ref());
+    uint64_t val = counter_get(addr & 0x1f);
+    return (addr & 0x80 ? val >> 32 : val);
+  }
+  if (addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31) return hpm_event[addr & 0x1f];
+  bad_csr(addr, "read");
+  return 0;
+}
+
+// the values of the counters, since their sources restart from 0
+typedef struct {
+  uint64_t val[NR_COUNTER];
+  uint64_t event[NR_COUNTER];
+} CounterState;
+
+size_t isa_cpt_save(void *buf, size_t size) {
+  CounterState *st = buf;
+  assert(size >= sizeof(*st));
+  for (int i = 0; i < NR_COUNTER; i ++) {
+    st->val[i] = counter_get(i);
+    st->event[i] = hpm_event[i];
+  }
+  return sizeof(*st);
+}
+
+// g_nr_guest_inst should be restored first
+void isa_cpt_restore(const void *buf, size_t size) {
+  const CounterState *st = buf;
+  Assert(size == sizeof(*st), "bad size of the counters in the checkpoint");
+  for (int i = 0; i < NR_COUNTER; i ++) {
+    hpm_event[i] = st->event[i];
+    offset[i] = counter_source(i) - st->val[i];
+  }
+}
+
+void csr_write(uint32_t addr, word_t val) {
+  if (is_counter(addr) && (addr & ~0x9fu) == CSR_CYCLE) {
+    // the user counters are read-only
+    INV(cpu.pc);
+    return;
+  }
+  if (is_counter(addr)) {
+    int idx = addr & 0x1f;
+#ifdef CONFIG_RV64
+    counter_set(idx, val);
+#else
+    uint64_t old = counter_get(idx);
+    if (addr & 0x80) counter_set(idx, (old & 0xffffffffull) | ((uint64_t)val << 32));
+    else counter_set(idx, (old & ~0xffffffffull) | val);
+#endif
+    return;
+  }
+  if (addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31) {
+    // keep the value of the counter when it starts to count another event
+    int idx = addr & 0x1f;
+    uint64_t old = counter_get(idx);
+    hpm_event[idx] = val;
+    counter_set(idx, old);
+    return;
+  }
+  bad_csr(addr, "write");
+}
@@ -0,0 +1,178 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <memory/cachesim.h>
+
+#ifdef CONFIG_CACHESIM
+/* The tags of a set are stored contiguously, padded to a multiple of the
+ * vector width, and compared with the requested tag in vectors. The valid
+ * and dirty bits of a set are bitmasks indexed by way.
+ */
+typedef MUXDEF(CONFIG_ISA64, uint64_t, uint32_t) tag_t;
+#define VEC_WIDTH (16 / sizeof(tag_t))
+typedef tag_t tagvec_t __attribute__((vector_size(VEC_WIDTH * sizeof(tag_t))));
+
+typedef struct {
+  char name[16];
+  int size, assoc, line;
+  int assoc_pad, line_shift;
+  uint32_t set_mask;
+  tagvec_t *tag;    // [nr_set][assoc_pad / VEC_WIDTH]
+  uint32_t *valid;  // [nr_set]
+  uint32_t *dirty;  // [nr_set]
+  uint64_t *stamp;  // [nr_set][assoc], last access for LRU, or fill time for FIFO
+  uint64_t tick;
+  uint64_t nr_access[2], nr_miss[2], nr_writeback;  // indexed by is_write
+} Cache;
+
+/* The first cache of each kind is the one configured by CONFIG_ICACHE_* or
+ * CONFIG_DCACHE_*, and is the one seen by the timing model. The others come
+ * from CONFIG_CACHESIM_EXTRA and see the same accesses in the same run.
+ */
+#define MAX_CACHE 8
+static Cache icache[MAX_CACHE] = {}, dcache[MAX_CACHE] = {};
+static int nr_icache = 0, nr_dcache = 0;
+
+static void cache_init(Cache *c, const char *name, int size, int assoc, int line) {
+  int nr_set = size / (assoc * line);
+  Assert(assoc >= 1 && assoc <= 32, "%s: associativity should be in [1, 32]", name);
+  Assert((line & (line - 1)) == 0 && nr_set > 0 && (nr_set & (nr_set - 1)) == 0 &&
+      nr_set * assoc * line == size, "%s: size and line size should be powers of 2", name);
+  *c = (Cache) { .size = size, .assoc = assoc, .line = line,
+    .assoc_pad = ROUNDUP(assoc, VEC_WIDTH), .line_shift = __builtin_ctz(line),
+    .set_mask = nr_set - 1 };
+  snprintf(c->name, sizeof(c->name), "%s", name);
+  c->tag = calloc(nr_set, c->assoc_pad * sizeof(tag_t));
+  c->valid = calloc(nr_set, sizeof(uint32_t));
+  c->dirty = calloc(nr_set, sizeof(uint32_t));
+  c->stamp = calloc(nr_set * assoc, sizeof(uint64_t));
+  assert(c->tag && c->valid && c->dirty && c->stamp);
+}
+
+// bitmask of the ways holding `tag`, including the invalid ones
+static inline uint32_t tag_match(const tagvec_t *set, int assoc_pad, tag_t tag) {
+  uint32_t hit = 0;
+  for (int v = 0; v < assoc_pad / VEC_WIDTH; v ++) {
+    tagvec_t eq = (tagvec_t)(set[v] == tag);
+    for (int j = 0; j < VEC_WIDTH; j ++) {
+      hit |= (uint32_t)(eq[j] & 1) << (v * VEC_WIDTH + j);
+    }
+  }
+  return hit;
+}
+
+static inline int victim(Cache *c, uint32_t set) {
+  uint32_t full = (c->assoc == 32 ? -1u : (1u << c->assoc) - 1);
+  uint32_t invalid = ~c->valid[set] & full;
+  if (invalid) return __builtin_ctz(invalid);
+#ifdef CONFIG_CACHE_RANDOM
+  return rand() % c->assoc;
+#else
+  uint64_t *stamp = &c->stamp[set * c->assoc];
+  int w = 0;
+  for (int i = 1; i < c->assoc; i ++) {
+    if (stamp[i] < stamp[w]) w = i;
+  }
+  return w;
+#endif
+}
+
+static inline void cache_access(Cache *c, vaddr_t addr, bool is_write) {
+  // the whole line number is used as the tag
+  tag_t tag = addr >> c->line_shift;
+  uint32_t set = tag & c->set_mask;
+  tagvec_t *tags = &c->tag[set * (c->assoc_pad / VEC_WIDTH)];
+  c->nr_access[is_write] ++;
+  c->tick ++;
+
+  uint32_t hit = tag_match(tags, c->assoc_pad, tag) & c->valid[set];
+  int w;
+  if (likely(hit)) {
+    w = __builtin_ctz(hit);
+  } else {
+    c->nr_miss[is_write] ++;
+    w = victim(c, set);
+    if (c->dirty[set] & (1u << w)) c->nr_writeback ++;
+    ((tag_t *)tags)[w] = tag;
+    c->valid[set] |= 1u << w;
+    c->dirty[set] &= ~(1u << w);
+    IFDEF(CONFIG_CACHE_FIFO, c->stamp[set * c->assoc + w] = c->tick);
+  }
+  IFDEF(CONFIG_CACHE_LRU, c->stamp[set * c->assoc + w] = c->tick);
+  if (is_write) c->dirty[set] |= 1u << w;
+}
+
+void cachesim_ifetch(vaddr_t addr) {
+  for (int i = 0; i < nr_icache; i ++) cache_access(&icache[i], addr, false);
+}
+
+void cachesim_access(vaddr_t addr, bool is_write) {
+  for (int i = 0; i < nr_dcache; i ++) cache_access(&dcache[i], addr, is_write);
+}
+
+uint64_t cachesim_nr_miss(bool is_icache) {
+  Cache *c = (is_icache ? &icache[0] : &dcache[0]);
+  return c->nr_miss[0] + c->nr_miss[1];
+}
+
+static void cache_report(Cache *c, bool show_write) {
+  uint64_t access = c->nr_access[0] + c->nr_access[1];
+  uint64_t miss = c->nr_miss[0] + c->nr_miss[1];
+  Log("%s: %d bytes, %d-way, %d-byte lines, " MUXDEF(CONFIG_CACHE_LRU, "LRU", MUXDEF(CONFIG_CACHE_FIFO, "FIFO", "random")),
+      c->name, c->size, c->assoc, c->line);
+  Log("%s: %" PRIu64 " accesses, %" PRIu64 " misses, hit rate = %.4f%%", c->name, access, miss,
+      (access ? (access - miss) * 100.0 / access : 0));
+  if (show_write) {
+    Log("%s: read %" PRIu64 "/%" PRIu64 ", write %" PRIu64 "/%" PRIu64 " (misses/accesses), %" PRIu64 " writebacks",
+        c->name, c->nr_miss[0], c->nr_access[0], c->nr_miss[1], c->nr_access[1], c->nr_writeback);
+  }
+}
+
+void cachesim_report() {
+  for (int i = 0; i < nr_icache; i ++) cache_report(&icache[i], false);
+  for (int i = 0; i < nr_dcache; i ++) cache_report(&dcache[i], true);
+}
+
+static void add_cache(char kind, int size, int assoc, int line) {
+  bool is_icache = (kind == 'i');
+  Cache *c = (is_icache ? icache : dcache);
+  int *nr = (is_icache ? &nr_icache : &nr_dcache);
+  Assert(*nr < MAX_CACHE, "at most %d caches of each kind are supported", MAX_CACHE);
+  char name[16];
+  if (*nr == 0) snprintf(name, sizeof(name), "%ccache", kind);
+  else snprintf(name, sizeof(name), "%ccache%d", kind, *nr);
+  cache_init(&c[*nr], name, size, assoc, line);
+  (*nr) ++;
+}
+
+// CONFIG_CACHESIM_EXTRA is a comma-separated list of KIND:SIZE:ASSOC:LINE
+static void add_extra_caches(const char *s) {
+  while (*s != '\0') {
+    char kind;
+    int size, assoc, line, n;
+    Assert(sscanf(s, " %c:%d:%d:%d%n", &kind, &size, &assoc, &line, &n) == 4 &&
+        (kind == 'i' || kind == 'd'), "bad cache configuration in CONFIG_CACHESIM_EXTRA: '%s'", s);
+    add_cache(kind, size, assoc, line);
+    s += n;
+    if (*s == ',') s ++;
+  }
+}
+
+void init_cachesim() {
+  add_cache('i', CONFIG_ICACHE_SIZE, CONFIG_ICACHE_ASSOC, CONFIG_ICACHE_LINE);
+  add_cache('d', CONFIG_DCACHE_SIZE, CONFIG_DCACHE_ASSOC, CONFIG_DCACHE_LINE);
+  add_extra_caches(CONFIG_CACHESIM_EXTRA);
+}
+#endif
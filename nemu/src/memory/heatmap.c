@@ -0,0 +1,128 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <memory/paddr.h>
+#include <memory/heatmap.h>
+
+#ifdef CONFIG_MEM_HEATMAP
+/* Each page of pmem has saturating counters of reads and writes. The
+ * working set is the number of pages touched in a window of
+ * CONFIG_MEM_HEATMAP_WINDOW instructions, which is tracked by a bitmap
+ * cleared at the end of each window. An access crossing a page boundary
+ * is counted on its first page only.
+ */
+#define NR_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+#define WINDOW CONFIG_MEM_HEATMAP_WINDOW
+
+static uint16_t page_count[2][NR_PAGE];  // indexed by is_write
+static uint64_t ws_bitmap[(NR_PAGE + 63) / 64];
+static uint32_t ws_size = 0;       // pages touched in the current window
+static uint64_t ws_next = WINDOW;  // the first instruction of the next window
+static uint64_t ws_start = 0;
+
+// the working sets of the finished windows
+static uint32_t *ws_series = NULL;
+static uint64_t *ws_series_start = NULL;
+static int nr_window = 0, max_window = 0;
+
+static const char *heatmap_file = NULL;
+
+static void window_end() {
+  extern uint64_t g_nr_guest_inst;
+  if (nr_window == max_window) {
+    max_window = (max_window == 0 ? 1024 : max_window * 2);
+    ws_series = realloc(ws_series, sizeof(ws_series[0]) * max_window);
+    ws_series_start = realloc(ws_series_start, sizeof(ws_series_start[0]) * max_window);
+    assert(ws_series && ws_series_start);
+  }
+  ws_series[nr_window] = ws_size;
+  ws_series_start[nr_window] = ws_start;
+  nr_window ++;
+
+  memset(ws_bitmap, 0, sizeof(ws_bitmap));
+  ws_size = 0;
+  // skip the windows without any access
+  ws_start = g_nr_guest_inst / WINDOW * WINDOW;
+  ws_next = ws_start + WINDOW;
+}
+
+void heatmap_access(paddr_t addr, bool is_write) {
+  extern uint64_t g_nr_guest_inst;
+  if (unlikely(g_nr_guest_inst >= ws_next)) window_end();
+  uint32_t page = (addr - PMEM_LEFT) >> PAGE_SHIFT;
+  uint16_t *c = &page_count[is_write][page];
+  *c += (*c != UINT16_MAX);
+  uint64_t bit = 1ull << (page % 64);
+  if (!(ws_bitmap[page / 64] & bit)) {
+    ws_bitmap[page / 64] |= bit;
+    ws_size ++;
+  }
+}
+
+static void write_heatmap(FILE *fp) {
+  fprintf(fp, "# working set: W <first instruction of the window> <pages touched>\n");
+  for (int i = 0; i < nr_window; i ++) {
+    fprintf(fp, "W %" PRIu64 " %u\n", ws_series_start[i], ws_series[i]);
+  }
+  if (ws_size > 0) fprintf(fp, "W %" PRIu64 " %u\n", ws_start, ws_size);
+  fprintf(fp, "# heatmap: P <page address> <reads> <writes>, saturated at %d\n", UINT16_MAX);
+  for (int i = 0; i < NR_PAGE; i ++) {
+    if (page_count[0][i] || page_count[1][i]) {
+      fprintf(fp, "P " FMT_PADDR " %u %u\n", (paddr_t)(PMEM_LEFT + ((paddr_t)i << PAGE_SHIFT)),
+          page_count[0][i], page_count[1][i]);
+    }
+  }
+}
+
+void heatmap_report() {
+  int nr_read = 0, nr_write = 0, nr_touch = 0;
+  for (int i = 0; i < NR_PAGE; i ++) {
+    nr_read += (page_count[0][i] != 0);
+    nr_write += (page_count[1][i] != 0);
+    nr_touch += (page_count[0][i] || page_count[1][i]);
+  }
+  Log("heatmap: footprint = %d pages (%d KiB), %d pages read, %d pages written",
+      nr_touch, nr_touch << (PAGE_SHIFT - 10), nr_read, nr_write);
+
+  if (nr_window > 0) {
+    // the unfinished last window is left out
+    uint32_t ws_min = ws_series[0], ws_max = ws_series[0];
+    uint64_t ws_sum = 0;
+    for (int i = 0; i < nr_window; i ++) {
+      if (ws_series[i] < ws_min) ws_min = ws_series[i];
+      if (ws_series[i] > ws_max) ws_max = ws_series[i];
+      ws_sum += ws_series[i];
+    }
+    Log("heatmap: working set per %d instructions: min = %u, avg = %.1f, max = %u pages in %d windows",
+        WINDOW, ws_min, (double)ws_sum / nr_window, ws_max, nr_window);
+  } else {
+    Log("heatmap: working set = %u pages in the first window", ws_size);
+  }
+
+  if (heatmap_file == NULL) return;
+  FILE *fp = fopen(heatmap_file, "w");
+  if (fp == NULL) {
+    Log("Can not open '%s' for the heatmap", heatmap_file);
+    return;
+  }
+  write_heatmap(fp);
+  fclose(fp);
+  Log("Heatmap of pages is written to %s", heatmap_file);
+}
+
+void init_heatmap(const char *file) {
+  heatmap_file = file;
+}
+#endif
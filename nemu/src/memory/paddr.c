@@ -15,7 +15,9 @@
 
 #include <memory/host.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 #include <device/mmio.h>
+#include <cpu/difftest.h>
 #include <isa.h>
 
 #if   defined(CONFIG_PMEM_MALLOC)
@@ -24,15 +26,66 @@ static uint8_t *pmem = NULL;
 static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
 
+uint8_t pmem_init_byte = 0;
+
 uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
+#ifdef CONFIG_PMEM_DIRTY
+// a bit of a page is cleared when its user has seen the page
+uint8_t pmem_dirty[NR_PMEM_PAGE] = {};
+
+static inline void dirty_mark(paddr_t addr, int len) {
+  // an unaligned store may cross the page boundary
+  pmem_dirty[(addr - PMEM_LEFT) >> PAGE_SHIFT] = 0xff;
+  pmem_dirty[(addr + len - 1 - PMEM_LEFT) >> PAGE_SHIFT] = 0xff;
+}
+
+void paddr_dirty_clear(int user) {
+  for (int i = 0; i < NR_PMEM_PAGE; i ++) {
+    pmem_dirty[i] &= ~(1u << user);
+  }
+}
+#endif
+
+#ifdef CONFIG_WATCHPOINT
+/* A page is marked if any data watchpoint lies on it. Stores to
+ * unmarked pages only pay for a single load in this filter.
+ */
+static uint8_t watched_page[CONFIG_MSIZE >> PAGE_SHIFT] = {};
+bool paddr_watch_triggered = false;
+
+void paddr_watch_add(paddr_t addr, int len) {
+  // also catch stores of at most 8 bytes which start before `addr`
+  paddr_t left = (addr - PMEM_LEFT < 8 ? PMEM_LEFT : addr - 7);
+  paddr_t right = addr + len - 1;
+  assert(in_pmem(left) && in_pmem(right));
+  for (paddr_t p = (left - PMEM_LEFT) >> PAGE_SHIFT; p <= (right - PMEM_LEFT) >> PAGE_SHIFT; p ++) {
+    watched_page[p] = 1;
+  }
+}
+
+void paddr_watch_clear() {
+  memset(watched_page, 0, sizeof(watched_page));
+  paddr_watch_triggered = false;
+}
+
+static inline void watch_check(paddr_t addr) {
+  if (unlikely(watched_page[(addr - PMEM_LEFT) >> PAGE_SHIFT])) {
+    paddr_watch_triggered = true;
+  }
+}
+#endif
+
 static word_t pmem_read(paddr_t addr, int len) {
   word_t ret = host_read(guest_to_host(addr), len);
   return ret;
 }
 
 static void pmem_write(paddr_t addr, int len, word_t data) {
+  IFDEF(CONFIG_WATCHPOINT, watch_check(addr));
+  IFDEF(CONFIG_PMEM_DIRTY, dirty_mark(addr, len));
+  IFDEF(CONFIG_DIFFTEST_PIPELINE, difftest_record_store(addr, len, data));
   host_write(guest_to_host(addr), len, data);
 }
 
@@ -46,19 +99,26 @@ void init_mem() {
   pmem = malloc(CONFIG_MSIZE);
   assert(pmem);
 #endif
-  IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE));
+  IFDEF(CONFIG_MEM_RANDOM, pmem_init_byte = rand(); memset(pmem, pmem_init_byte, CONFIG_MSIZE));
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
 word_t paddr_read(paddr_t addr, int len) {
-  if (likely(in_pmem(addr))) return pmem_read(addr, len);
+  SELF_PROF_SCOPE(SP_MEM);
+  if (likely(in_pmem(addr))) {
+    return pmem_read(addr, len);
+  }
   IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
   out_of_bound(addr);
   return 0;
 }
 
 void paddr_write(paddr_t addr, int len, word_t data) {
-  if (likely(in_pmem(addr))) { pmem_write(addr, len, data); return; }
+  SELF_PROF_SCOPE(SP_MEM);
+  if (likely(in_pmem(addr))) {
+    pmem_write(addr, len, data);
+    return;
+  }
   IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
   out_of_bound(addr);
 }
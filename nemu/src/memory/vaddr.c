@@ -14,16 +14,39 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
 #include <memory/paddr.h>
+#include <cpu/commitlog.h>
+#include <memory/cachesim.h>
+#include <memory/heatmap.h>
+
+/* The memory models only see the accesses of the executing instruction to
+ * the physical memory, not the ones to devices, nor the ones of the monitor
+ * (such as `x` and watchpoints).
+ */
+static inline void mem_model_access(vaddr_t addr, bool is_write) {
+  if (!g_inst_exec || !in_pmem(addr)) return;
+  IFDEF(CONFIG_CACHESIM, cachesim_access(addr, is_write));
+  IFDEF(CONFIG_MEM_HEATMAP, heatmap_access(addr, is_write));
+}
 
 word_t vaddr_ifetch(vaddr_t addr, int len) {
+  if (likely(in_pmem(addr))) {
+    IFDEF(CONFIG_CACHESIM, cachesim_ifetch(addr));
+    IFDEF(CONFIG_MEM_HEATMAP, heatmap_access(addr, false));
+  }
   return paddr_read(addr, len);
 }
 
 word_t vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  mem_model_access(addr, false);
+  word_t data = paddr_read(addr, len);
+  IFDEF(CONFIG_COMMITLOG, commitlog_mem(addr, len, data, false));
+  return data;
 }
 
 void vaddr_write(vaddr_t addr, int len, word_t data) {
+  mem_model_access(addr, true);
+  IFDEF(CONFIG_COMMITLOG, commitlog_mem(addr, len, data, true));
   paddr_write(addr, len, data);
 }
@@ -15,6 +15,15 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/cachesim.h>
+#include <memory/heatmap.h>
+#include <cpu/commitlog.h>
+#include <cpu/callstack.h>
+#include <cpu/profile.h>
+#include <cpu/ftrace.h>
+#include <cpu/inst-stat.h>
+#include <cpu/bpsim.h>
+#include <cpu/simpoint.h>
 
 void init_rand();
 void init_log(const char *log_file);
@@ -42,6 +51,15 @@ void sdb_set_batch_mode();
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *commitlog_file = NULL;
+static char *elf_file = NULL;
+static char *profile_file = NULL;
+static char *stat_file = NULL;
+static char *bbv_file = NULL;
+static char *simpoints_file = NULL;
+static char *cpt_dir = NULL;
+static char *restore_file = NULL;
+static char *heatmap_file = NULL;
 static int difftest_port = 1234;
 
 static long load_img() {
@@ -72,16 +90,34 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"commit-log", required_argument, NULL, 'c'},
+    {"elf"      , required_argument, NULL, 'e'},
+    {"profile"  , required_argument, NULL, 'P'},
+    {"stat"     , required_argument, NULL, 's'},
+    {"bbv"      , required_argument, NULL, 'B'},
+    {"simpoints", required_argument, NULL, 'S'},
+    {"checkpoint", required_argument, NULL, 'k'},
+    {"restore"  , required_argument, NULL, 'r'},
+    {"heatmap"  , required_argument, NULL, 'H'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:c:e:P:s:B:S:k:r:H:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'c': commitlog_file = optarg; break;
+      case 'e': elf_file = optarg; break;
+      case 'P': profile_file = optarg; break;
+      case 's': stat_file = optarg; break;
+      case 'B': bbv_file = optarg; break;
+      case 'S': simpoints_file = optarg; break;
+      case 'k': cpt_dir = optarg; break;
+      case 'r': restore_file = optarg; break;
+      case 'H': heatmap_file = optarg; break;
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -89,6 +125,15 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-c,--commit-log=FILE    write the binary commit log to FILE\n");
+        printf("\t-e,--elf=FILE           read the symbols of the image from FILE\n");
+        printf("\t-P,--profile=FILE       write the folded stacks of the profiler to FILE\n");
+        printf("\t-s,--stat=FILE          write the statistics of instructions to FILE in JSON\n");
+        printf("\t-B,--bbv=FILE           write the basic block vectors of SimPoint to FILE\n");
+        printf("\t-S,--simpoints=FILE     take checkpoints at the intervals listed in FILE\n");
+        printf("\t-k,--checkpoint=DIR     save the checkpoints to DIR\n");
+        printf("\t-r,--restore=FILE       restore the checkpoint in FILE after loading the image\n");
+        printf("\t-H,--heatmap=FILE       write the working sets and the page heatmap to FILE\n");
         printf("\n");
         exit(0);
     }
@@ -101,6 +146,10 @@ void init_monitor(int argc, char *argv[]) {
 
   /* Parse arguments. */
   parse_args(argc, argv);
+#ifndef CONFIG_SIMPOINT
+  Assert(bbv_file == NULL && simpoints_file == NULL && cpt_dir == NULL && restore_file == NULL,
+      "--bbv, --simpoints, --checkpoint and --restore need CONFIG_SIMPOINT in menuconfig");
+#endif
 
   /* Set random seed. */
   init_rand();
@@ -110,6 +159,8 @@ void init_monitor(int argc, char *argv[]) {
 
   /* Initialize memory. */
   init_mem();
+  IFDEF(CONFIG_CACHESIM, init_cachesim());
+  IFDEF(CONFIG_MEM_HEATMAP, init_heatmap(heatmap_file));
 
   /* Initialize devices. */
   IFDEF(CONFIG_DEVICE, init_device());
@@ -120,9 +171,30 @@ void init_monitor(int argc, char *argv[]) {
   /* Load the image to memory. This will overwrite the built-in image. */
   long img_size = load_img();
 
+  /* Restore the checkpoint and set up the generation of SimPoint inputs. */
+  IFDEF(CONFIG_SIMPOINT, if (restore_file) img_size = simpoint_restore(restore_file));
+  IFDEF(CONFIG_SIMPOINT, init_simpoint(bbv_file, simpoints_file, cpt_dir));
+
+  /* Read the symbols of the image. */
+  init_elf(elf_file);
+  IFDEF(CONFIG_CALLSTACK, init_callstack());
+  IFDEF(CONFIG_FTRACE, init_ftrace());
+
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
+  /* Open the binary commit log. */
+  IFDEF(CONFIG_COMMITLOG, init_commitlog(commitlog_file));
+
+  /* Initialize the sampling profiler. */
+  IFDEF(CONFIG_PROFILE, init_profile(profile_file));
+
+  /* Initialize the statistics of instructions. */
+  IFDEF(CONFIG_INST_STAT, init_inst_stat(stat_file));
+
+  /* Initialize the branch predictors. */
+  IFDEF(CONFIG_BPSIM, init_bpsim());
+
   /* Initialize the simple debugger. */
   init_sdb();
 
@@ -0,0 +1,117 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include "sdb.h"
+#include <cpu/cpu.h>
+
+#define NR_BP 32
+#define BP_HASH_SIZE 128 // should be a power of 2 and larger than NR_BP
+
+typedef struct {
+  int NO;
+  vaddr_t pc;
+} BP;
+
+/* Breakpoints are kept in an open-addressing hash table indexed by pc,
+ * so that checking the pc costs at most a few probes. `nr_bp` is tested
+ * before calling bp_check(), so there is no cost when no breakpoint is set.
+ */
+static BP bp_table[BP_HASH_SIZE] = {};
+// a breakpoint set by REF to run to a pc, which stops silently
+#define BP_TEMP -1
+int nr_bp = 0;
+static int next_NO = 1;
+
+static inline int bp_hash(vaddr_t pc) {
+  return ((pc >> 2) * 2654435761u) & (BP_HASH_SIZE - 1);
+}
+
+static BP* bp_find(vaddr_t pc) {
+  for (int i = bp_hash(pc); bp_table[i].NO != 0; i = (i + 1) & (BP_HASH_SIZE - 1)) {
+    if (bp_table[i].pc == pc) return &bp_table[i];
+  }
+  return NULL;
+}
+
+static void bp_insert(int NO, vaddr_t pc) {
+  int i = bp_hash(pc);
+  while (bp_table[i].NO != 0) i = (i + 1) & (BP_HASH_SIZE - 1);
+  bp_table[i] = (BP) { .NO = NO, .pc = pc };
+}
+
+void bp_check(vaddr_t pc) {
+  BP *bp = bp_find(pc);
+  if (bp != NULL && nemu_state.state == NEMU_RUNNING) {
+    if (bp->NO != BP_TEMP) printf("Breakpoint [%d] hit at " FMT_WORD "\n", bp->NO, pc);
+    nemu_state.state = NEMU_STOP;
+  }
+}
+
+void bp_add(vaddr_t pc) {
+  if (bp_find(pc) != NULL) {
+    printf("Breakpoint at " FMT_WORD " already exists.\n", pc);
+  } else if (nr_bp == NR_BP) {
+    printf("Too many breakpoints!\n");
+  } else {
+    bp_insert(next_NO, pc);
+    printf("Breakpoint [%d] at " FMT_WORD "\n", next_NO, pc);
+    next_NO ++;
+    nr_bp ++;
+  }
+}
+
+void bp_display() {
+  for (int i = 0; i < BP_HASH_SIZE; i ++) {
+    if (bp_table[i].NO != 0) {
+      printf("Breakpoint [%d]: pc=" FMT_WORD "\n", bp_table[i].NO, bp_table[i].pc);
+    }
+  }
+}
+
+static bool bp_remove(int NO) {
+  BP old[BP_HASH_SIZE];
+  memcpy(old, bp_table, sizeof(bp_table));
+  memset(bp_table, 0, sizeof(bp_table));
+  // rebuild the table to keep the probing sequences valid
+  bool found = false;
+  for (int i = 0; i < BP_HASH_SIZE; i ++) {
+    if (old[i].NO == 0) continue;
+    if (old[i].NO == NO) { found = true; continue; }
+    bp_insert(old[i].NO, old[i].pc);
+  }
+  if (found) nr_bp --;
+  return found;
+}
+
+void bp_delete(int NO) {
+  if (bp_remove(NO)) {
+    printf("Breakpoint [%d] deleted.\n", NO);
+  } else {
+    printf("No breakpoint number %d.\n", NO);
+  }
+}
+
+// run until the next time `pc` is reached, or the execution stops
+void bp_run_to(vaddr_t pc) {
+  bool is_new = (bp_find(pc) == NULL);
+  if (is_new) {
+    assert(nr_bp < NR_BP);
+    bp_insert(BP_TEMP, pc);
+    nr_bp ++;
+  }
+  cpu_exec(-1);
+  if (is_new) bp_remove(BP_TEMP);
+}
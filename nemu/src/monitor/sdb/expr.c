@@ -15,6 +15,7 @@
 
 #include <isa.h>
 #include <memory/vaddr.h>
+#include "sdb.h"
 
 /* We use the POSIX regex functions to process regular expressions.
  * Type 'man regex' for more information about POSIX regex functions.
@@ -135,10 +136,45 @@ static bool make_token(char *e) {
   return true;
 }
 
-// flag for expr evaluation
-static bool eval_success;
+/* An expression is compiled only once into a small postfix program,
+ * so that it can be evaluated repeatedly (e.g. by watchpoints after
+ * every instruction) without tokenizing and parsing it again.
+ */
+enum {
+  OP_CONST = 512, // push a constant
+  OP_REG,         // push the value of a register
+  OP_AND_JZ,      // if the top is zero, jump to `target`, else pop it
+  OP_BOOL,        // convert the top to 0 or 1
+  /* other operators are represented by their token types */
+};
+
+typedef struct {
+  int op;
+  union {
+    word_t val;
+    const word_t *reg;
+    int target;
+  };
+} ExprInst;
+
+struct ExprCode {
+  int len;
+  ExprInst inst[];
+};
+
+static ExprInst code_buf[ARRLEN(tokens) * 2] = {};
+static int code_len = 0;
 
-static word_t eval_single_token(int i) {
+// flag for expr compilation
+static bool compile_success;
+
+static int emit(int op) {
+  Assert(code_len < ARRLEN(code_buf), "Expression too long!");
+  code_buf[code_len].op = op;
+  return code_len ++;
+}
+
+static void compile_single_token(int i) {
   char *endptr;
   Token *token = &tokens[i];
   unsigned long val_ul = 0;
@@ -149,7 +185,7 @@ static word_t eval_single_token(int i) {
     if (endptr == tokens[i].str) {
       // invalid number
       Log("Invalid unsigned decimal number.");
-      eval_success = false;
+      compile_success = false;
     }
     break;
   case TK_HEX:
@@ -158,36 +194,39 @@ static word_t eval_single_token(int i) {
     if (endptr == tokens[i].str) {
       // invalid number
       Log("Invalid unsigned hexadecimal number.");
-      eval_success = false;
+      compile_success = false;
     }
     break;
-  case TK_REG:
-    val_ul = isa_reg_str2val(tokens[i].str + 1, &eval_success);
-    if (!eval_success) {
+  case TK_REG: {
+    const word_t *reg = isa_reg_str2ptr(tokens[i].str + 1);
+    if (reg == NULL) {
       Log("Invalid register: %s", tokens[i].str + 1);
+      compile_success = false;
+      return;
     }
-    break;
+    code_buf[emit(OP_REG)].reg = reg;
+    return;
+  }
 
   default:
     // invalid single token
     Log("Invalid single token type: %d", token->type);
-    eval_success = false;
-    val_ul = -1;
-    break;
+    compile_success = false;
+    return;
   }
 
-  if (eval_success) {
+  if (compile_success) {
 #ifndef CONFIG_ISA64
     // check for UL to word_t overflow
     if (val_ul > UINT32_MAX) {
       // overflow
       Log("Number overflow.");
-      eval_success = false;
+      compile_success = false;
     }
 #endif
   }
 
-  return (word_t)val_ul;
+  code_buf[emit(OP_CONST)].val = (word_t)val_ul;
 }
 
 static bool is_paren_match(int l, int r) {  
@@ -259,86 +298,43 @@ static int get_op_with_lowest_precedence(int l, int r) {
   return -1;
 }
 
-static word_t eval_expr(int l, int r) {
-  // printf("Now evaluating %d, %d\n",l,r);
+static void compile_expr(int l, int r) {
   // the binary operator with lowest precedence
   int pos = -1;
-  if (l > r) {
+  if (!compile_success) {
+    return;
+  } else if (l > r) {
     // bad expression
-    eval_success = false;
-    return -1;
+    compile_success = false;
   } else if (l == r) {
     // single token
-    word_t val = eval_single_token(l);
-    if(!eval_success)
-      return -1;
-    return val;
+    compile_single_token(l);
   } else if(tokens[l].type == '(' && tokens[r].type == ')' && is_paren_match(l + 1, r - 1)){
     // remove paren
-    return eval_expr(l + 1, r - 1);
-  } else if((pos = get_op_with_lowest_precedence(l, r)) != -1){    
+    compile_expr(l + 1, r - 1);
+  } else if((pos = get_op_with_lowest_precedence(l, r)) != -1){
     // "main" operator
     int op_type = tokens[pos].type;
 
-    // eval left part and right part
-    word_t left_val = eval_expr(l, pos - 1);
-    if(op_type == TK_AND && !left_val)
-      return 0;
-
-    word_t right_val = eval_expr(pos + 1, r);
-    word_t expr_val = -1;
-    if(!eval_success)
-      return -1;
-
-    switch (op_type) {
-    case '+':
-      expr_val = left_val + right_val;
-      break;
-    case '-':
-      expr_val = left_val - right_val;
-      break;
-    case '*':
-      expr_val = left_val * right_val;
-      break;
-    case '/':
-      // ATTENTION: div by zero
-      if (right_val == 0) {
-        eval_success = false;
-        Log("Div by zero.");
-      } else {
-        expr_val = left_val / right_val;
-      }
-      break;
-    case TK_EQ:
-      expr_val = (left_val == right_val);
-      break;
-
-    case TK_NEQ:
-      expr_val = (left_val != right_val);
-      break;
-
-    case TK_AND:
-      expr_val = (left_val && right_val);
-      break;
-
-    default:
-      Log("Invalid binary operator");
-      eval_success = false;
-      break;
+    compile_expr(l, pos - 1);
+    if (op_type == TK_AND) {
+      // short-circuit: the right part is not evaluated if the left part is 0
+      int jz = emit(OP_AND_JZ);
+      compile_expr(pos + 1, r);
+      emit(OP_BOOL);
+      code_buf[jz].target = code_len;
+    } else {
+      compile_expr(pos + 1, r);
+      emit(op_type);
     }
-
-    return expr_val;
   } else {
     // unary operator
-    if (tokens[l].type == TK_UNARY_MINUS) {
-      return -eval_expr(l + 1, r);
-    } else if (tokens[l].type == TK_DEREF) {
-      word_t addr = eval_expr(l + 1, r);    
-      return eval_success ? vaddr_read(addr, 4) : -1;
+    if (tokens[l].type == TK_UNARY_MINUS || tokens[l].type == TK_DEREF) {
+      compile_expr(l + 1, r);
+      emit(tokens[l].type);
     } else {
-      eval_success = false;
+      compile_success = false;
       Log("Invalid unary operator: %d\n", tokens[l].type);
-      return -1;
     }
   }
 }
@@ -361,29 +357,95 @@ static void fix_op_types() {
   }
 }
 
-word_t expr(char *e, bool *success) {
+ExprCode* expr_compile(char *e) {
   if (!make_token(e)) {
-    *success = false;
-    return 0;
+    return NULL;
   }
 
-  /* TODO: Insert codes to evaluate the expression. */
-  // TODO();
-  // for (int i = 0; i < nr_token; ++i) {
-  //   printf("%10d", i);
-  // }
-  // puts("");
+  fix_op_types();
 
-  // for (int i = 0; i < nr_token; ++i) {
-  //   printf("%10s", tokens[i].str);
-  // }
-  // puts("");
+  code_len = 0;
+  compile_success = true;
+  compile_expr(0, nr_token - 1);
+  if (!compile_success) {
+    return NULL;
+  }
 
-  fix_op_types();
+  ExprCode *code = malloc(sizeof(ExprCode) + sizeof(ExprInst) * code_len);
+  assert(code);
+  code->len = code_len;
+  memcpy(code->inst, code_buf, sizeof(ExprInst) * code_len);
+  return code;
+}
 
-  eval_success = true;  
-  word_t val = eval_expr(0, nr_token - 1);
-  *success = eval_success;
-  
+void expr_free(ExprCode *code) {
+  free(code);
+}
+
+word_t expr_eval(ExprCode *code, bool *success) {
+  word_t stack[code->len];
+  int top = -1;
+  *success = true;
+
+  for (int pc = 0; pc < code->len; pc ++) {
+    ExprInst *inst = &code->inst[pc];
+    switch (inst->op) {
+    case OP_CONST: stack[++ top] = inst->val; break;
+    case OP_REG: stack[++ top] = *inst->reg; break;
+    case OP_AND_JZ:
+      if (stack[top] == 0) pc = inst->target - 1;
+      else top --;
+      break;
+    case OP_BOOL: stack[top] = (stack[top] != 0); break;
+    case TK_UNARY_MINUS: stack[top] = -stack[top]; break;
+    case TK_DEREF: stack[top] = vaddr_read(stack[top], 4); break;
+    default: {
+      word_t right_val = stack[top --];
+      word_t left_val = stack[top];
+      word_t expr_val = -1;
+      switch (inst->op) {
+      case '+': expr_val = left_val + right_val; break;
+      case '-': expr_val = left_val - right_val; break;
+      case '*': expr_val = left_val * right_val; break;
+      case '/':
+        // ATTENTION: div by zero
+        if (right_val == 0) {
+          Log("Div by zero.");
+          *success = false;
+          return -1;
+        }
+        expr_val = left_val / right_val;
+        break;
+      case TK_EQ: expr_val = (left_val == right_val); break;
+      case TK_NEQ: expr_val = (left_val != right_val); break;
+      default: panic("Invalid binary operator %d", inst->op);
+      }
+      stack[top] = expr_val;
+    }
+    }
+  }
+
+  assert(top == 0);
+  return stack[0];
+}
+
+// check whether the expression is in the form of `*ADDR`
+bool expr_is_deref_const(ExprCode *code, word_t *addr) {
+  if (code->len == 2 && code->inst[0].op == OP_CONST && code->inst[1].op == TK_DEREF) {
+    *addr = code->inst[0].val;
+    return true;
+  }
+  return false;
+}
+
+word_t expr(char *e, bool *success) {
+  ExprCode *code = expr_compile(e);
+  if (code == NULL) {
+    *success = false;
+    return 0;
+  }
+
+  word_t val = expr_eval(code, success);
+  expr_free(code);
   return val;
 }
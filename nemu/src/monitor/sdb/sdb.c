@@ -68,6 +68,10 @@ static int cmd_w(char *args);
 
 static int cmd_d(char *args);
 
+static int cmd_b(char *args);
+
+static int cmd_delete(char *args);
+
 static struct {
   const char *name;
   const char *description;
@@ -81,7 +85,9 @@ static struct {
   { "p", "Evaluate expression.", cmd_p},
   { "x", "Examine memory.", cmd_x},
   { "w", "Set watch point.", cmd_w},
-  { "d", "Delete watch point", cmd_d}
+  { "d", "Delete watch point", cmd_d},
+  { "b", "Set breakpoint at the address given by an expression.", cmd_b},
+  { "delete", "Delete breakpoint", cmd_delete}
 
   /* TODO: Add more commands */
 
@@ -141,7 +147,7 @@ static int cmd_info(char *args) {
 
   if (arg == NULL) {
     // need argument
-    printf("Need argument: r(registers) or w(watchpoints)\n");
+    printf("Need argument: r(registers), w(watchpoints) or b(breakpoints)\n");
   } else {
     if (strcmp("r", arg) == 0) {
       // print registers
@@ -149,6 +155,9 @@ static int cmd_info(char *args) {
     } else if (strcmp("w", arg) == 0) {
       // print watch points
       wp_display();
+    } else if (strcmp("b", arg) == 0) {
+      // print breakpoints
+      bp_display();
     }
   }
 
@@ -237,6 +246,41 @@ static int cmd_d(char *args) {
   return 0;
 }
 
+static int cmd_b(char *args) {
+  // the rest of line is the first argument: [expr]
+  char *arg = args;
+
+  if (arg == NULL) {
+    // need argument
+    printf("Format: b [expr]\n");
+  } else {
+    bool success = true;
+    vaddr_t pc = expr(arg, &success);
+    if (success) {
+      bp_add(pc);
+    } else {
+      printf("[expr] not valid!\n");
+    }
+  }
+
+  return 0;
+}
+
+static int cmd_delete(char *args) {
+  // extract the first argument: breakpoint NO
+  char *arg = strtok(NULL, " ");
+
+  if (arg == NULL) {
+    // need argument
+    printf("Format: delete NO\n");
+  } else {
+    int NO = atoi(arg);
+    bp_delete(NO);
+  }
+
+  return 0;
+}
+
 void sdb_set_batch_mode() {
   is_batch_mode = true;
 }
@@ -263,8 +307,8 @@ void sdb_mainloop() {
     }
 
 #ifdef CONFIG_DEVICE
-    extern void sdl_clear_event_queue();
-    sdl_clear_event_queue();
+    extern void device_clear_input();
+    device_clear_input();
 #endif
 
     int i;
@@ -20,6 +20,12 @@
 
 word_t expr(char *e, bool *success);
 
+typedef struct ExprCode ExprCode;
+ExprCode* expr_compile(char *e);
+word_t expr_eval(ExprCode *code, bool *success);
+void expr_free(ExprCode *code);
+bool expr_is_deref_const(ExprCode *code, word_t *addr);
+
 void wp_check(vaddr_t pc);
 
 void wp_add(char *s);
@@ -28,4 +34,12 @@ void wp_display();
 
 void wp_delete(int NO);
 
+void bp_check(vaddr_t pc);
+
+void bp_add(vaddr_t pc);
+
+void bp_display();
+
+void bp_delete(int NO);
+
 #endif
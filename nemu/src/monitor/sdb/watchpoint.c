@@ -13,8 +13,10 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#include <isa.h>
 #include "sdb.h"
 #include <cpu/cpu.h>
+#include <memory/paddr.h>
 
 #define NR_WP 32
 
@@ -23,6 +25,9 @@ typedef struct watchpoint {
   struct watchpoint *next;
   word_t last_value;
   char *expr;
+  ExprCode *code; // compiled from `expr`
+  bool is_data;   // `*ADDR`, only checked when a store hits ADDR
+  paddr_t addr;
   /* TODO: Add more members if necessary */
 
 } WP;
@@ -30,6 +35,7 @@ typedef struct watchpoint {
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL, *free_last = NULL;
 static int next_NO = NR_WP; 
+static int nr_expr_wp = 0;
 
 void init_wp_pool() {
   int i;
@@ -45,12 +51,35 @@ void init_wp_pool() {
 
 /* TODO: Implement the functionality of watchpoint */
 
+#ifdef CONFIG_WATCHPOINT
+static bool is_data_wp(ExprCode *code, paddr_t *paddr) {
+  word_t addr;
+  if (!expr_is_deref_const(code, &addr)) return false;
+  if (isa_mmu_check(addr, 4, MEM_TYPE_READ) != MMU_DIRECT) return false;
+  if (!in_pmem(addr) || !in_pmem(addr + 3)) return false;
+  *paddr = addr;
+  return true;
+}
+
+static void update_data_wp_filter() {
+  paddr_watch_clear();
+  for (WP *cur = head; cur; cur = cur->next) {
+    if (cur->is_data) paddr_watch_add(cur->addr, 4);
+  }
+}
+
 void wp_check(vaddr_t pc) {  
+  // data watchpoints can only change when a store hits them
+  bool data_hit = paddr_watch_triggered;
+  if (likely(nr_expr_wp == 0 && !data_hit)) return;
+  paddr_watch_triggered = false;
+
   WP *cur = head;
   bool changed = false;
   while (cur) {
+    if (cur->is_data && !data_hit) { cur = cur->next; continue; }
     bool success = true;
-    word_t new_val = expr(cur->expr, &success);
+    word_t new_val = expr_eval(cur->code, &success);
     if (!success) {
       Log("Invalid expr.");
     } else {
@@ -69,16 +98,22 @@ void wp_check(vaddr_t pc) {
     set_nemu_state(NEMU_STOP, pc, -1);
   }
 }
+#endif
 
 void wp_add(char *s)
 {  
   if(free_){
-    bool success = true;    
-    free_->last_value = expr(s, &success);
+    bool success = false;
+    ExprCode *code = expr_compile(s);
+    if (code) free_->last_value = expr_eval(code, &success);
     if(!success){
-      printf("Invalid expr.\n");      
+      printf("Invalid expr.\n");
+      if (code) expr_free(code);
       return;
     }
+    free_->code = code;
+    free_->is_data = MUXDEF(CONFIG_WATCHPOINT, is_data_wp(code, &free_->addr), false);
+    if (!free_->is_data) nr_expr_wp ++;
     int len = strlen(s) + 1;
     free_->expr = malloc(len);
     memcpy(free_->expr, s, len);
@@ -90,6 +125,7 @@ void wp_add(char *s)
       // running out of free watch points
       free_last = NULL;
     }
+    IFDEF(CONFIG_WATCHPOINT, if (head->is_data) update_data_wp_filter());
   }else{
     printf("Too many watch points!\n");
   }
@@ -99,8 +135,8 @@ void wp_display() {
   WP *cur = head;
   while (cur) {
     bool success = true;
-    word_t val = expr(cur->expr, &success);
-    printf("Watch point [%d]: expr=%s, value=", cur->NO, cur->expr);    
+    word_t val = expr_eval(cur->code, &success);
+    printf("Watch point [%d]: expr=%s%s, value=", cur->NO, cur->expr, cur->is_data ? " (data)" : "");    
     if (!success) {
       printf("Not Available\n") ;
     } else {
@@ -125,12 +161,15 @@ void wp_delete(int NO) {
       cur->next = NULL;
       cur->NO = next_NO++;
       free(cur->expr);
+      expr_free(cur->code);
+      if (!cur->is_data) nr_expr_wp --;
+      IFDEF(CONFIG_WATCHPOINT, if (cur->is_data) update_data_wp_filter());
       if (free_) {
         free_last->next = cur;
       } else {
         free_ = cur;
-        free_last = cur;
       }
+      free_last = cur;
       printf("Watch point [%d] deleted.\n", NO);
     }
     prev = cur;
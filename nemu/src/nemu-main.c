@@ -19,6 +19,7 @@
 void init_monitor(int, char *[]);
 void am_init_monitor();
 void engine_start();
+void device_run(void (*engine)());
 int is_exit_status_bad();
 
 word_t expr(char *e, bool *success);
@@ -54,7 +55,11 @@ int main(int argc, char *argv[]) {
   } else {
 
     /* Start engine. */
+#ifdef CONFIG_DEVICE
+    device_run(engine_start);
+#else
     engine_start();
+#endif
 
     return is_exit_status_bad();
   }
@@ -0,0 +1,53 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+
+/* A 64-bit xxHash-style digest. It is used to compare large states
+ * (registers, memory pages) between NEMU and a reference design
+ * without transferring them, so speed matters more than quality.
+ */
+
+#define PRIME1 0x9e3779b185ebca87ull
+#define PRIME2 0xc2b2ae3d27d4eb4full
+#define PRIME3 0x165667b19e3779f9ull
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t round64(uint64_t acc, uint64_t in) {
+  return rotl(acc + in * PRIME2, 31) * PRIME1;
+}
+
+uint64_t hash64(const void *buf, size_t len) {
+  const uint8_t *p = buf;
+  uint64_t h = PRIME3 + len;
+  for (; len >= 8; len -= 8, p += 8) {
+    uint64_t in;
+    memcpy(&in, p, 8);
+    h ^= round64(0, in);
+    h = rotl(h, 27) * PRIME1 + PRIME3;
+  }
+  for (; len > 0; len --, p ++) {
+    h ^= *p * PRIME3;
+    h = rotl(h, 11) * PRIME1;
+  }
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+  return h;
+}
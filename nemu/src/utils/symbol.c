@@ -0,0 +1,104 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+
+#ifndef CONFIG_TARGET_AM
+#include <elf.h>
+
+typedef struct {
+  vaddr_t addr;
+  word_t size;
+  char *name;
+} Symbol;
+
+// function symbols sorted by address
+static Symbol *syms = NULL;
+static int nr_sym = 0;
+
+#define def_load_symtab(bits) \
+static void concat(load_symtab, bits)(uint8_t *elf) { \
+  concat3(Elf, bits, _Ehdr) *eh = (void *)elf; \
+  concat3(Elf, bits, _Shdr) *sh = (void *)(elf + eh->e_shoff); \
+  for (int i = 0; i < eh->e_shnum; i ++) { \
+    if (sh[i].sh_type != SHT_SYMTAB) continue; \
+    concat3(Elf, bits, _Sym) *sym = (void *)(elf + sh[i].sh_offset); \
+    char *strtab = (char *)elf + sh[sh[i].sh_link].sh_offset; \
+    int n = sh[i].sh_size / sizeof(*sym); \
+    syms = realloc(syms, sizeof(Symbol) * (nr_sym + n)); \
+    for (int j = 0; j < n; j ++) { \
+      if (concat3(ELF, bits, _ST_TYPE)(sym[j].st_info) != STT_FUNC) continue; \
+      syms[nr_sym ++] = (Symbol) { .addr = sym[j].st_value, .size = sym[j].st_size, \
+        .name = strdup(strtab + sym[j].st_name) }; \
+    } \
+  } \
+}
+
+def_load_symtab(32)
+def_load_symtab(64)
+
+static int symbol_cmp(const void *a, const void *b) {
+  vaddr_t x = ((const Symbol *)a)->addr, y = ((const Symbol *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+void init_elf(const char *elf_file) {
+  if (elf_file == NULL) return;
+
+  FILE *fp = fopen(elf_file, "rb");
+  Assert(fp, "Can not open '%s'", elf_file);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  uint8_t *elf = malloc(size);
+  fseek(fp, 0, SEEK_SET);
+  int ret = fread(elf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Assert(size >= EI_NIDENT && memcmp(elf, ELFMAG, SELFMAG) == 0, "'%s' is not an ELF file", elf_file);
+  if (elf[EI_CLASS] == ELFCLASS64) load_symtab64(elf);
+  else load_symtab32(elf);
+  free(elf);
+
+  qsort(syms, nr_sym, sizeof(Symbol), symbol_cmp);
+  Log("Read %d function symbols from %s", nr_sym, elf_file);
+}
+
+int symbol_find(vaddr_t addr) {
+  // the last symbol with syms[i].addr <= addr
+  int lo = 0, hi = nr_sym;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (syms[mid].addr <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  int i = lo - 1;
+  if (i < 0) return -1;
+  // a symbol without size is assumed to extend to the next one
+  return (syms[i].size == 0 || addr - syms[i].addr < syms[i].size ? i : -1);
+}
+
+const char* symbol_name(int idx) {
+  return syms[idx].name;
+}
+
+vaddr_t symbol_addr(int idx) {
+  return syms[idx].addr;
+}
+
+int symbol_nr() {
+  return nr_sym;
+}
+#endif
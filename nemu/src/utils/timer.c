@@ -44,6 +44,38 @@ uint64_t get_time() {
   return now - boot_time;
 }
 
+#ifdef CONFIG_SELF_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SELF_PROF_UNIT "TSC cycles"
+uint64_t self_prof_now() { return __rdtsc(); }
+#else
+#include <time.h>
+#define SELF_PROF_UNIT "ns"
+uint64_t self_prof_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+#endif
+
+uint64_t self_prof_cycles[NR_SP] = {};
+
+void self_prof_report() {
+  static const char *name[NR_SP] = {
+    [SP_EXECUTE] = "execute", [SP_EXEC_ONCE] = "  exec_once",
+    [SP_MEM] = "    memory", [SP_MMIO] = "      mmio",
+    [SP_TRACE] = "  trace", [SP_DIFFTEST] = "  difftest", [SP_DEVICE] = "  device",
+  };
+  uint64_t total = self_prof_cycles[SP_EXECUTE];
+  if (total == 0) return;
+  Log("host time breakdown in " SELF_PROF_UNIT ", where a part contains the indented ones below:");
+  for (int i = 0; i < NR_SP; i ++) {
+    Log("%-12s %'16" PRIu64 " %6.2f%%", name[i], self_prof_cycles[i], self_prof_cycles[i] * 100.0 / total);
+  }
+}
+#endif
+
 void init_rand() {
   srand(get_time_internal());
 }
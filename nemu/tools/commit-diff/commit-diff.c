@@ -0,0 +1,206 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/* Compare two binary commit logs written by NEMU with --commit-log,
+ * and report the first divergence with the instructions around it.
+ * Usage: commit-diff [-n CONTEXT] LOG_A LOG_B
+ * The exit status is 0 if the logs agree, 1 if they diverge, or 2 on error.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <commitlog-def.h>
+
+typedef struct {
+  uint64_t idx;
+  uint64_t pc;
+  uint32_t inst;
+  uint8_t flag, rd;
+  uint64_t val;
+  uint64_t addr, data;
+} Record;
+
+typedef struct {
+  const char *name;
+  FILE *fp;
+  int word_size;
+  uint64_t mask;
+  uint8_t buf[CLOG_CHUNK_SIZE];
+  uint8_t zbuf[CLOG_CHUNK_SIZE];
+  const uint8_t *p, *end;
+  uint32_t left;  // records left in the current chunk
+  uint64_t idx;
+  // the values the records are delta-encoded against
+  uint64_t pc, addr, val[CLOG_NR_REG];
+} Reader;
+
+static Reader a = {}, b = {};
+
+static void fail(Reader *r, const char *msg) {
+  fprintf(stderr, "commit-diff: %s: %s at instruction %" PRIu64 "\n", r->name, msg, r->idx);
+  exit(2);
+}
+
+static void reader_open(Reader *r, const char *name) {
+  ClogHeader h;
+  r->name = name;
+  r->fp = fopen(name, "rb");
+  if (r->fp == NULL) { perror(name); exit(2); }
+  if (fread(&h, sizeof(h), 1, r->fp) != 1 || memcmp(h.magic, CLOG_MAGIC, sizeof(h.magic)) != 0) {
+    fail(r, "not a commit log");
+  }
+  if (h.version != CLOG_VERSION) fail(r, "unsupported version");
+  r->word_size = h.word_size;
+  r->mask = (h.word_size >= 8 ? -1ull : (1ull << (h.word_size * 8)) - 1);
+}
+
+static bool load_chunk(Reader *r) {
+  ClogChunkHeader c;
+  if (fread(&c, sizeof(c), 1, r->fp) != 1) return false;
+  if (c.size > sizeof(r->buf) || c.zsize > sizeof(r->zbuf)) fail(r, "bad chunk");
+  if (c.zsize == 0) {
+    if (fread(r->buf, c.size, 1, r->fp) != 1) fail(r, "truncated chunk");
+  } else {
+    if (fread(r->zbuf, c.zsize, 1, r->fp) != 1) fail(r, "truncated chunk");
+    uLongf size = sizeof(r->buf);
+    if (uncompress(r->buf, &size, r->zbuf, c.zsize) != Z_OK || size != c.size) {
+      fail(r, "bad compressed chunk");
+    }
+  }
+  if (c.first_inst != r->idx) fail(r, "chunk out of order");
+  r->p = r->buf;
+  r->end = r->buf + c.size;
+  r->left = c.nr_inst;
+  r->pc = r->addr = 0;
+  memset(r->val, 0, sizeof(r->val));
+  return true;
+}
+
+static uint64_t get_varint(Reader *r) {
+  uint64_t v;
+  r->p = clog_get_varint(r->p, r->end, &v);
+  if (r->p == NULL) fail(r, "bad record");
+  return v;
+}
+
+static uint64_t get_delta(Reader *r, uint64_t last) {
+  return (last + clog_unzigzag(get_varint(r))) & r->mask;
+}
+
+static bool next(Reader *r, Record *rec) {
+  while (r->left == 0) {
+    if (!load_chunk(r)) return false;
+  }
+  if (r->p + 1 + sizeof(uint32_t) > r->end) fail(r, "bad record");
+  memset(rec, 0, sizeof(*rec));
+  rec->idx = r->idx;
+  rec->flag = *r->p ++;
+  rec->pc = r->pc = get_delta(r, r->pc);
+  if (r->p + sizeof(uint32_t) > r->end) fail(r, "bad record");
+  memcpy(&rec->inst, r->p, sizeof(rec->inst));
+  r->p += sizeof(rec->inst);
+  if (rec->flag & CLOG_RD) {
+    if (r->p >= r->end) fail(r, "bad record");
+    rec->rd = *r->p ++;
+    if (rec->rd >= CLOG_NR_REG) fail(r, "bad register");
+    rec->val = r->val[rec->rd] = get_delta(r, r->val[rec->rd]);
+  }
+  if (rec->flag & (CLOG_LOAD | CLOG_STORE)) {
+    rec->addr = r->addr = get_delta(r, r->addr);
+    rec->data = get_varint(r);
+  }
+  r->left --;
+  r->idx ++;
+  return true;
+}
+
+static bool same(const Record *x, const Record *y) {
+  return x->pc == y->pc && x->inst == y->inst && x->flag == y->flag && x->rd == y->rd &&
+    x->val == y->val && x->addr == y->addr && x->data == y->data;
+}
+
+static void show(const char *prefix, const Record *r, int w) {
+  printf("%s %10" PRIu64 "  pc = 0x%0*" PRIx64 "  inst = 0x%08x", prefix, r->idx, w, r->pc, r->inst);
+  if (r->flag & CLOG_RD) printf("  r%-2d = 0x%0*" PRIx64, r->rd, w, r->val);
+  if (r->flag & (CLOG_LOAD | CLOG_STORE)) {
+    printf("  %s%d [0x%0*" PRIx64 "] = 0x%" PRIx64, (r->flag & CLOG_STORE ? "st" : "ld"),
+        1 << ((r->flag & CLOG_LEN_MASK) >> CLOG_LEN_SHIFT), w, r->addr, r->data);
+  }
+  printf("\n");
+}
+
+static void show_after(Reader *r, const char *prefix, int n, int w) {
+  Record rec;
+  for (int i = 0; i < n && next(r, &rec); i ++) show(prefix, &rec, w);
+}
+
+int main(int argc, char *argv[]) {
+  int context = 5;
+  int o;
+  while ((o = getopt(argc, argv, "n:")) != -1) {
+    switch (o) {
+      case 'n': context = atoi(optarg); break;
+      default: goto usage;
+    }
+  }
+  if (argc - optind != 2 || context < 0) goto usage;
+
+  reader_open(&a, argv[optind]);
+  reader_open(&b, argv[optind + 1]);
+  if (a.word_size != b.word_size) {
+    fprintf(stderr, "commit-diff: the logs have different word sizes\n");
+    return 2;
+  }
+  int w = a.word_size * 2;
+
+  // the records agreed so far, for the context before the divergence
+  Record *history = malloc(sizeof(Record) * (context + 1));
+  Record ra, rb;
+  uint64_t n = 0;
+  while (true) {
+    bool has_a = next(&a, &ra);
+    bool has_b = next(&b, &rb);
+    if (!has_a && !has_b) {
+      printf("The logs agree on all %" PRIu64 " instructions\n", n);
+      return 0;
+    }
+    if (has_a && has_b && same(&ra, &rb)) {
+      history[n % (context + 1)] = ra;
+      n ++;
+      continue;
+    }
+
+    if (!has_a || !has_b) {
+      printf("%s ends after %" PRIu64 " instructions, but %s goes on\n",
+          (has_a ? b.name : a.name), n, (has_a ? a.name : b.name));
+    } else {
+      printf("The logs diverge at instruction %" PRIu64 "\n", n);
+    }
+    uint64_t start = (n > context ? n - context : 0);
+    for (uint64_t i = start; i < n; i ++) show(" ", &history[i % (context + 1)], w);
+    if (has_a) { show("<", &ra, w); show_after(&a, "<", context, w); }
+    if (has_b) { show(">", &rb, w); show_after(&b, ">", context, w); }
+    printf("< %s\n> %s\n", a.name, b.name);
+    return 1;
+  }
+
+usage:
+  fprintf(stderr, "Usage: %s [-n CONTEXT] LOG_A LOG_B\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,102 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+/* Serve the difftest requests from DUT with a REF loaded in this process.
+ * Usage: difftest-shm FD REF_SO
+ * FD is a file descriptor of the shared memory holding a DifftestShm.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <difftest-shm.h>
+
+static void (*ref_memcpy)(paddr_t addr, void *buf, size_t n, bool direction) = NULL;
+static void (*ref_regcpy)(void *dut, bool direction) = NULL;
+static void (*ref_exec)(uint64_t n) = NULL;
+static void (*ref_raise_intr)(uint64_t NO) = NULL;
+static void (*ref_init)(int port) = NULL;
+static size_t (*ref_dirty)(paddr_t *pages, size_t max) = NULL;
+static void (*ref_memhash)(const paddr_t *pages, uint64_t *hash, size_t n) = NULL;
+static bool (*ref_run_to_pc)(vaddr_t pc) = NULL;
+
+static void* load_sym(void *handle, const char *name, bool optional) {
+  void *p = dlsym(handle, name);
+  if (p == NULL && !optional) {
+    fprintf(stderr, "difftest-shm: %s is not found in REF\n", name);
+    exit(1);
+  }
+  return p;
+}
+
+static void serve(DifftestShm *shm) {
+  switch (shm->cmd) {
+    case SHM_CMD_HELLO:
+      shm->arg = (ref_dirty && ref_memhash ? SHM_HAS_MEMCHECK : 0) |
+        (ref_run_to_pc ? SHM_HAS_RUN_TO_PC : 0);
+      break;
+    case SHM_CMD_INIT: ref_init(shm->arg); break;
+    case SHM_CMD_MEMCPY: ref_memcpy(shm->addr, shm->data, shm->n, shm->direction); break;
+    case SHM_CMD_REGCPY: ref_regcpy(shm->data, shm->direction); break;
+    case SHM_CMD_EXEC: ref_exec(shm->n); break;
+    case SHM_CMD_RAISE_INTR: ref_raise_intr(shm->arg); break;
+    case SHM_CMD_DIRTY: shm->n = ref_dirty((paddr_t *)shm->data, shm->arg); break;
+    case SHM_CMD_MEMHASH:
+      // the hashes follow the pages
+      ref_memhash((paddr_t *)shm->data, (uint64_t *)(shm->data + shm->n * sizeof(uint64_t)), shm->n);
+      break;
+    case SHM_CMD_RUN_TO_PC: shm->arg = ref_run_to_pc(shm->addr); break;
+    default:
+      fprintf(stderr, "difftest-shm: bad command %d\n", shm->cmd);
+      exit(1);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s FD REF_SO\n", argv[0]);
+    return 1;
+  }
+
+  DifftestShm *shm = mmap(NULL, sizeof(DifftestShm), PROT_READ | PROT_WRITE,
+      MAP_SHARED, atoi(argv[1]), 0);
+  if (shm == MAP_FAILED) {
+    perror("difftest-shm: mmap");
+    return 1;
+  }
+
+  void *handle = dlopen(argv[2], RTLD_LAZY);
+  if (handle == NULL) {
+    fprintf(stderr, "difftest-shm: %s\n", dlerror());
+    return 1;
+  }
+  ref_memcpy = load_sym(handle, "difftest_memcpy", false);
+  ref_regcpy = load_sym(handle, "difftest_regcpy", false);
+  ref_exec = load_sym(handle, "difftest_exec", false);
+  ref_raise_intr = load_sym(handle, "difftest_raise_intr", false);
+  ref_init = load_sym(handle, "difftest_init", false);
+  ref_dirty = load_sym(handle, "difftest_dirty", true);
+  ref_memhash = load_sym(handle, "difftest_memhash", true);
+  ref_run_to_pc = load_sym(handle, "difftest_run_to_pc", true);
+
+  // the server is killed with DUT, see init_difftest()
+  for (uint32_t seq = 1; ; seq ++) {
+    shm_wait(&shm->req_seq, seq, -1);
+    serve(shm);
+    shm_ring(&shm->resp_seq, seq);
+  }
+  return 0;
+}
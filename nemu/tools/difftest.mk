@@ -25,4 +25,12 @@ $(DIFF_REF_SO):
 endif
 
 .PHONY: $(DIFF_REF_SO)
+
+ifdef CONFIG_DIFFTEST_SHM
+DIFF_SHM_SERVER = $(NEMU_HOME)/tools/difftest-shm/build/difftest-shm
+$(DIFF_SHM_SERVER):
+	$(MAKE) -s -C $(NEMU_HOME)/tools/difftest-shm
+
+.PHONY: $(DIFF_SHM_SERVER)
+endif
 endif
@@ -327,6 +327,63 @@ static void kvm_exec(uint64_t n) {
   }
 }
 
+// Let the guest run freely until it fetches the instruction at `pc`.
+// Only the hardware breakpoint in DR0 is armed, so the guest runs at
+// full speed. TF is cleared, so the patching for pushf/popf/iret, which
+// hides TF from the guest, is not needed until single-stepping resumes.
+// There are no devices, so an I/O or MMIO exit stops the run and false
+// is returned. DUT then copies its state to REF.
+static bool kvm_run_to(uint32_t pc) {
+  struct kvm_regs *r = &(vcpu.kvm_run->s.regs.regs);
+  assert(vcpu.int_wp_state == STATE_IDLE);
+  // the breakpoint fires at once if it is set at the current instruction
+  if (r->rip == pc) kvm_exec(1);
+
+  r->rflags &= ~RFLAGS_TF;
+  vcpu.kvm_run->kvm_dirty_regs = KVM_SYNC_X86_REGS;
+
+  struct kvm_guest_debug debug = {};
+  debug.control = KVM_GUESTDBG_ENABLE | KVM_GUESTDBG_USE_HW_BP;
+  debug.arch.debugreg[0] = pc;
+  debug.arch.debugreg[7] = 0x1;
+  if (ioctl(vcpu.fd, KVM_SET_GUEST_DEBUG, &debug) < 0) {
+    perror("KVM_SET_GUEST_DEBUG");
+    assert(0);
+  }
+
+  bool reached = false;
+  while (1) {
+    if (ioctl(vcpu.fd, KVM_RUN, 0) < 0) {
+      if (errno == EINTR) continue;
+      perror("KVM_RUN");
+      assert(0);
+    }
+
+    uint32_t reason = vcpu.kvm_run->exit_reason;
+    if (reason == KVM_EXIT_HLT) break;
+    if (reason == KVM_EXIT_DEBUG && vcpu.kvm_run->debug.arch.pc == pc) { reached = true; break; }
+    if (reason == KVM_EXIT_IO || reason == KVM_EXIT_MMIO) {
+      fprintf(stderr, "Got an access to a device at pc = 0x%llx when running to 0x%x\n", r->rip, pc);
+      // finish the pending access without entering the guest, so that
+      // the registers copied from DUT are not overwritten by it
+      vcpu.kvm_run->immediate_exit = 1;
+      int ret = ioctl(vcpu.fd, KVM_RUN, 0);
+      assert(ret < 0 && errno == EINTR);
+      vcpu.kvm_run->immediate_exit = 0;
+      break;
+    }
+    fprintf(stderr, "Got exit_reason %d at pc = 0x%llx when running to 0x%x\n",
+        reason, r->rip, pc);
+    assert(0);
+  }
+
+  // back to lockstep
+  r->rflags |= RFLAGS_TF;
+  vcpu.kvm_run->kvm_dirty_regs = KVM_SYNC_X86_REGS;
+  kvm_set_step_mode(false, 0);
+  return reached;
+}
+
 static void run_protected_mode() {
   struct kvm_sregs sregs;
   kvm_getsregs(&sregs);
@@ -382,6 +439,10 @@ __EXPORT void difftest_exec(uint64_t n) {
   kvm_exec(n);
 }
 
+__EXPORT bool difftest_run_to_pc(vaddr_t pc) {
+  return kvm_run_to(pc);
+}
+
 __EXPORT void difftest_raise_intr(word_t NO) {
   uint32_t pgate_vaddr = vcpu.kvm_run->s.regs.sregs.idt.base + NO * 8;
   uint32_t pgate = va2pa(pgate_vaddr);
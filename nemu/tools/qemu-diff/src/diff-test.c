@@ -20,19 +20,18 @@
 
 bool gdb_connect_qemu(int);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
+bool gdb_memcpy_from_qemu(uint32_t, void *, int);
 bool gdb_getregs(union isa_gdb_regs *);
 bool gdb_setregs(union isa_gdb_regs *);
-bool gdb_si();
+bool gdb_si(uint64_t n);
 void gdb_exit();
 
 void init_isa();
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
-  assert(direction == DIFFTEST_TO_REF);
-  if (direction == DIFFTEST_TO_REF) {
-    bool ok = gdb_memcpy_to_qemu(addr, buf, n);
-    assert(ok == 1);
-  }
+  bool ok = (direction == DIFFTEST_TO_REF ?
+      gdb_memcpy_to_qemu(addr, buf, n) : gdb_memcpy_from_qemu(addr, buf, n));
+  assert(ok == 1);
 }
 
 __EXPORT void difftest_regcpy(void *dut, bool direction) {
@@ -47,7 +46,7 @@ __EXPORT void difftest_regcpy(void *dut, bool direction) {
 }
 
 __EXPORT void difftest_exec(uint64_t n) {
-  while (n --) gdb_si();
+  gdb_si(n);
 }
 
 __EXPORT void difftest_init(int port) {
@@ -16,6 +16,11 @@
 #include "common.h"
 
 static struct gdb_conn *conn;
+static char *buf = NULL; // reused by all packets sent
+static bool binary_write = true;
+
+// the packet size of the gdbstub in QEMU is 4096
+#define MTU 1500
 
 bool gdb_connect_qemu(int port) {
   // connect to gdbserver on localhost port 1234
@@ -23,93 +28,126 @@ bool gdb_connect_qemu(int port) {
     usleep(1);
   }
 
+  // every packet is checked by TCP, so the acks are not necessary
+  gdb_start_noack(conn);
+  buf = malloc(MTU * 2 + 128);
+  assert(buf != NULL);
+
   return true;
 }
 
-static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
-  char *buf = malloc(len * 2 + 128);
-  assert(buf != NULL);
-  int p = sprintf(buf, "M0x%x,%x:", dest, len);
+static bool gdb_reply_ok() {
+  size_t size;
+  uint8_t *reply = gdb_recv(conn, &size);
+  return !strcmp((const char*)reply, "OK");
+}
+
+static int hex_encode_bytes(char *dst, const uint8_t *src, int len) {
   int i;
   for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+    dst[i * 2] = hex_encode(src[i] >> 4);
+    dst[i * 2 + 1] = hex_encode(src[i] & 0xf);
   }
+  return len * 2;
+}
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
-  free(buf);
-
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
+static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
+  if (binary_write) {
+    int p = sprintf(buf, "X%x,%x:", dest, len);
+    int i;
+    for (i = 0; i < len; i ++) {
+      uint8_t c = ((uint8_t *)src)[i];
+      if (c == '$' || c == '#' || c == '}' || c == '*') {
+        buf[p ++] = '}';
+        c ^= 0x20;
+      }
+      buf[p ++] = c;
+    }
+    gdb_send(conn, (const uint8_t *)buf, p);
+
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    if (size != 0) return !strcmp((const char*)reply, "OK");
+    // an empty reply means that the X packet is not supported
+    binary_write = false;
+  }
 
-  return ok;
+  int p = sprintf(buf, "M%x,%x:", dest, len);
+  p += hex_encode_bytes(buf + p, src, len);
+  gdb_send(conn, (const uint8_t *)buf, p);
+  return gdb_reply_ok();
 }
 
 bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
-  const int mtu = 1500;
   bool ok = true;
-  while (len > mtu) {
-    ok &= gdb_memcpy_to_qemu_small(dest, src, mtu);
-    dest += mtu;
-    src += mtu;
-    len -= mtu;
+  while (len > MTU) {
+    ok &= gdb_memcpy_to_qemu_small(dest, src, MTU);
+    dest += MTU;
+    src += MTU;
+    len -= MTU;
   }
   ok &= gdb_memcpy_to_qemu_small(dest, src, len);
   return ok;
 }
 
+bool gdb_memcpy_from_qemu(uint32_t src, void *dest, int len) {
+  while (len > 0) {
+    int n = (len > MTU ? MTU : len);
+    int p = sprintf(buf, "m%x,%x", src, n);
+    gdb_send(conn, (const uint8_t *)buf, p);
+
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    if (size != n * 2) return false;
+    int i;
+    for (i = 0; i < n; i ++) {
+      ((uint8_t *)dest)[i] = gdb_decode_hex(reply[i * 2], reply[i * 2 + 1]);
+    }
+    src += n;
+    dest += n;
+    len -= n;
+  }
+  return true;
+}
+
 bool gdb_getregs(union isa_gdb_regs *r) {
   gdb_send(conn, (const uint8_t *)"g", 1);
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
 
+  // registers are sent in the target byte order
   int i;
   uint8_t *p = reply;
-  uint8_t c;
-  for (i = 0; i < sizeof(union isa_gdb_regs) / sizeof(uint32_t); i ++) {
-    c = p[8];
-    p[8] = '\0';
-    r->array[i] = gdb_decode_hex_str(p);
-    p[8] = c;
-    p += 8;
+  for (i = 0; i < sizeof(union isa_gdb_regs) && p + 1 < reply + size; i ++, p += 2) {
+    ((uint8_t *)r)[i] = gdb_decode_hex(p[0], p[1]);
   }
 
-  free(reply);
-
   return true;
 }
 
 bool gdb_setregs(union isa_gdb_regs *r) {
+  static char *regbuf = NULL;
   int len = sizeof(union isa_gdb_regs);
-  char *buf = malloc(len * 2 + 128);
-  assert(buf != NULL);
-  buf[0] = 'G';
-
-  void *src = r;
-  int p = 1;
-  int i;
-  for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+  if (regbuf == NULL) {
+    regbuf = malloc(len * 2 + 2);
+    assert(regbuf != NULL);
   }
+  regbuf[0] = 'G';
+  int p = 1 + hex_encode_bytes(regbuf + 1, (uint8_t *)r, len);
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
-  free(buf);
-
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
-
-  return ok;
+  gdb_send(conn, (const uint8_t *)regbuf, p);
+  return gdb_reply_ok();
 }
 
-bool gdb_si() {
-  char buf[] = "vCont;s:1";
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  free(reply);
+// Step `n` instructions. In all-stop mode the next step can only be
+// sent after the stop reply of the previous one is received.
+bool gdb_si(uint64_t n) {
+  static const char cmd[] = "vCont;s:1";
+  for (; n > 0; n --) {
+    gdb_send(conn, (const uint8_t *)cmd, sizeof(cmd) - 1);
+    size_t size;
+    gdb_recv(conn, &size);
+  }
   return true;
 }
 
@@ -20,6 +20,7 @@
 #include "common.h"
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
 
 #include <arpa/inet.h>
 
@@ -29,12 +30,20 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+// The connection is accessed through the raw socket with our own
+// buffers, which are reused by all packets.
 struct gdb_conn {
-  FILE *in;
-  FILE *out;
+  int fd;
   bool ack;
+  uint8_t *in;       // received bytes
+  size_t in_pos, in_len;
+  uint8_t *out;      // the packet being sent
+  size_t out_size;
+  uint8_t *reply;    // the payload of the last packet received
+  size_t reply_size;
 };
 
+#define IN_BUF_SIZE 65536
 
 static uint8_t
 hex_nibble(uint8_t hex) {
@@ -63,31 +72,54 @@ uint64_t gdb_decode_hex_str(uint8_t *bytes) {
 }
 
 
+static void conn_write(struct gdb_conn *conn, const void *buf, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(conn->fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      err(1, "send");
+    }
+    buf += n;
+    size -= n;
+  }
+}
+
+static int conn_getc(struct gdb_conn *conn) {
+  if (conn->in_pos == conn->in_len) {
+    ssize_t n;
+    do {
+      n = read(conn->fd, conn->in, IN_BUF_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) err(1, "recv");
+    if (n == 0) errx(0, "recv: Connection closed");
+    conn->in_pos = 0;
+    conn->in_len = n;
+  }
+  return conn->in[conn->in_pos ++];
+}
+
+// only valid right after conn_getc()
+static void conn_ungetc(struct gdb_conn *conn) {
+  conn->in_pos --;
+}
+
 static struct gdb_conn* gdb_begin(int fd) {
   struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn));
   if (conn == NULL)
     err(1, "calloc");
 
+  conn->fd = fd;
   conn->ack = true;
-
-  // duplicate the handle to separate read/write state
-  int fd2 = dup(fd);
-  if (fd2 < 0)
-    err(1, "dup");
-
-  // open a FILE* for reading
-  conn->in = fdopen(fd, "rb");
-  if (conn->in == NULL)
-    err(1, "fdopen");
-
-  // open a FILE* for writing
-  conn->out = fdopen(fd2, "wb");
-  if (conn->out == NULL)
-    err(1, "fdopen");
+  conn->in = malloc(IN_BUF_SIZE);
+  conn->out_size = 4096;
+  conn->out = malloc(conn->out_size);
+  conn->reply_size = 4096;
+  conn->reply = malloc(conn->reply_size);
+  if (conn->in == NULL || conn->out == NULL || conn->reply == NULL)
+    err(1, "malloc");
 
   // reset line state by acking any earlier input
-  fputc('+', conn->out);
-  fflush(conn->out);
+  conn_write(conn, "+", 1);
 
   return conn;
 }
@@ -130,12 +162,21 @@ struct gdb_conn* gdb_begin_inet(const char *addr, uint16_t port) {
 
 
 void gdb_end(struct gdb_conn *conn) {
-  fclose(conn->in);
-  fclose(conn->out);
+  close(conn->fd);
+  free(conn->in);
+  free(conn->out);
+  free(conn->reply);
   free(conn);
 }
 
-static void send_packet(FILE *out, const uint8_t *command, size_t size) {
+static void send_packet(struct gdb_conn *conn, const uint8_t *command, size_t size) {
+  if (size + 4 > conn->out_size) {
+    conn->out_size = size + 4;
+    conn->out = realloc(conn->out, conn->out_size);
+    if (conn->out == NULL)
+      err(1, "realloc");
+  }
+
   // compute the checksum -- simple mod256 addition
   uint8_t sum = 0;
   size_t i;
@@ -146,45 +187,50 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
   // gdbserver.  e.g. giving "invalid hex digit" on an RLE'd address.
   // So just write raw here, and maybe let higher levels escape/RLE.
 
-  fputc('$', out); // packet start
-  fwrite(command, 1, size, out); // payload
-  fprintf(out, "#%02X", sum); // packet end, checksum
-  fflush(out);
-
-  if (ferror(out))
-    err(1, "send");
-  else if (feof(out))
-    errx(0, "send: Connection closed");
+  // write the whole packet with a single syscall
+  uint8_t *p = conn->out;
+  *p ++ = '$'; // packet start
+  memcpy(p, command, size); // payload
+  p += size;
+  *p ++ = '#'; // packet end, checksum
+  *p ++ = hex_encode(sum >> 4);
+  *p ++ = hex_encode(sum & 0xf);
+  conn_write(conn, conn->out, p - conn->out);
 }
 
 void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   bool acked = false;
   do {
-    send_packet(conn->out, command, size);
+    send_packet(conn, command, size);
 
     if (!conn->ack)
       break;
 
     // look for '+' ACK or '-' NACK/resend
-    acked = fgetc(conn->in) == '+';
+    acked = conn_getc(conn) == '+';
   } while (!acked);
 }
 
-static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
-  size_t i = 0;
-  size_t size = 4096;
-  uint8_t *reply = malloc(size);
-  if (reply == NULL)
-    err(1, "malloc");
+static void reply_reserve(struct gdb_conn *conn, size_t size) {
+  if (size > conn->reply_size) {
+    while (conn->reply_size < size) conn->reply_size *= 2;
+    conn->reply = realloc(conn->reply, conn->reply_size);
+    if (conn->reply == NULL)
+      err(1, "realloc");
+  }
+}
 
+static uint8_t* recv_packet(struct gdb_conn *conn, size_t *ret_size, bool* ret_sum_ok) {
+  size_t i = 0;
   int c;
   uint8_t sum = 0;
   bool escape = false;
 
   // fast-forward to the first start of packet
-  while ((c = fgetc(in)) != EOF && c != '$');
+  while ((c = conn_getc(conn)) != '$');
 
-  while ((c = fgetc(in)) != EOF) {
+  while (true) {
+    c = conn_getc(conn);
     sum += c;
     switch (c) {
       case '$': // new packet?  start over...
@@ -196,21 +242,17 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
       case '#': // end of packet
         sum -= c; // not part of the checksum
         {
-          uint8_t msb = fgetc(in);
-          uint8_t lsb = fgetc(in);
+          uint8_t msb = conn_getc(conn);
+          uint8_t lsb = conn_getc(conn);
           *ret_sum_ok = sum == gdb_decode_hex(msb, lsb);
         }
         *ret_size = i;
 
         // terminate it for good measure
-        if (i == size) {
-          reply = realloc(reply, size + 1);
-          if (reply == NULL)
-            err(1, "realloc");
-        }
-        reply[i] = '\0';
+        reply_reserve(conn, i + 1);
+        conn->reply[i] = '\0';
 
-        return reply;
+        return conn->reply;
 
       case '}': // escape: next char is XOR 0x20
         escape = true;
@@ -223,23 +265,18 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
         // The count character can't be >126 or '$'/'#' packet markers.
 
         if (i > 0) { // need something to repeat!
-          int c2 = fgetc(in);
+          int c2 = conn_getc(conn);
           if (c2 < 29 || c2 > 126 || c2 == '$' || c2 == '#') {
             // invalid count character!
-            ungetc(c2, in);
+            conn_ungetc(conn);
           } else {
             int count = c2 - 29;
 
             // get a bigger buffer if needed
-            if (i + count > size) {
-              size *= 2;
-              reply = realloc(reply, size);
-              if (reply == NULL)
-                err(1, "realloc");
-            }
+            reply_reserve(conn, i + count);
 
             // fill the repeated character
-            memset(&reply[i], reply[i - 1], count);
+            memset(&conn->reply[i], conn->reply[i - 1], count);
             i += count;
             sum += c2;
             continue;
@@ -254,37 +291,26 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
     }
 
     // get a bigger buffer if needed
-    if (i == size) {
-      size *= 2;
-      reply = realloc(reply, size);
-      if (reply == NULL)
-        err(1, "realloc");
-    }
+    reply_reserve(conn, i + 1);
 
     // add one character
-    reply[i++] = c;
+    conn->reply[i++] = c;
   }
-
-  if (ferror(in))
-    err(1, "recv");
-  else if (feof(in))
-    errx(0, "recv: Connection closed");
-  else
-    errx(1, "recv: Unknown connection error");
 }
 
+// The returned buffer is owned by `conn`, and
+// it is only valid until the next packet is received.
 uint8_t* gdb_recv(struct gdb_conn *conn, size_t *size) {
   uint8_t *reply;
   bool acked = false;
   do {
-    reply = recv_packet(conn->in, size, &acked);
+    reply = recv_packet(conn, size, &acked);
 
     if (!conn->ack)
       break;
 
     // send +/- depending on checksum result, retry if needed
-    fputc(acked ? '+' : '-', conn->out);
-    fflush(conn->out);
+    conn_write(conn, acked ? "+" : "-", 1);
   } while (!acked);
 
   return reply;
@@ -297,7 +323,6 @@ const char* gdb_start_noack(struct gdb_conn *conn) {
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
   bool ok = size == 2 && !strcmp((const char*)reply, "OK");
-  free(reply);
 
   if (ok)
     conn->ack = false;
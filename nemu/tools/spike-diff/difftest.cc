@@ -56,34 +56,60 @@ void sim_t::diff_step(uint64_t n) {
 
 void sim_t::diff_get_regs(void* diff_context) {
   struct diff_context_t* ctx = (struct diff_context_t*)diff_context;
-  for (int i = 0; i < NR_GPR; i++) {
-    ctx->gpr[i] = state->XPR[i];
+  if (sizeof(word_t) == sizeof(reg_t)) {
+    // RV64: the register file of Spike has the same layout as CPU_state
+    memcpy(ctx->gpr, &state->XPR[0], sizeof(ctx->gpr));
+  } else {
+    for (int i = 0; i < NR_GPR; i++) {
+      ctx->gpr[i] = state->XPR[i];
+    }
   }
   ctx->pc = state->pc;
 }
 
 void sim_t::diff_set_regs(void* diff_context) {
   struct diff_context_t* ctx = (struct diff_context_t*)diff_context;
-  for (int i = 0; i < NR_GPR; i++) {
-    state->XPR.write(i, (sword_t)ctx->gpr[i]);
+  if (sizeof(word_t) == sizeof(reg_t)) {
+    // RV64: no sign extension is needed, and gpr[0] of DUT is always 0
+    memcpy(const_cast<reg_t*>(&state->XPR[0]), ctx->gpr, sizeof(ctx->gpr));
+  } else {
+    for (int i = 0; i < NR_GPR; i++) {
+      state->XPR.write(i, (sword_t)ctx->gpr[i]);
+    }
   }
   state->pc = ctx->pc;
 }
 
-void sim_t::diff_memcpy(reg_t dest, void* src, size_t n) {
-  mmu_t* mmu = p->get_mmu();
-  for (size_t i = 0; i < n; i++) {
-    mmu->store<uint8_t>(dest+i, *((uint8_t*)src+i));
+// Copy with the host address of each page instead of storing byte by byte
+// through the MMU. A large copy (e.g. the whole memory) is then cheap.
+static void spike_memcpy(reg_t addr, void *buf, size_t n, bool direction) {
+  simif_t *sim = s;
+  uint8_t *b = (uint8_t *)buf;
+  while (n > 0) {
+    size_t len = std::min<size_t>(n, PGSIZE - (addr & (PGSIZE - 1)));
+    char *host = sim->addr_to_mem(addr);
+    assert(host != NULL);
+    if (direction == DIFFTEST_TO_REF) memcpy(host, b, len);
+    else memcpy(b, host, len);
+    addr += len;
+    b += len;
+    n -= len;
   }
 }
 
+void sim_t::diff_memcpy(reg_t dest, void* src, size_t n) {
+  spike_memcpy(dest, src, n, DIFFTEST_TO_REF);
+  // the decoded instructions may come from the old content
+  p->get_mmu()->flush_icache();
+}
+
 extern "C" {
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
   if (direction == DIFFTEST_TO_REF) {
     s->diff_memcpy(addr, buf, n);
   } else {
-    assert(0);
+    spike_memcpy(addr, buf, n, DIFFTEST_TO_DUT);
   }
 }
 